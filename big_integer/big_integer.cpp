@@ -1,11 +1,91 @@
 #include "big_integer.hpp"
 
+#ifdef BIGINT_STATS
+#include <atomic>
+#endif
+
 const std::string BigInt::kInt64MinStr =
     std::to_string(std::numeric_limits<int64_t>::min());
 
+#ifdef BIGINT_STATS
+namespace {
+struct StatsCounters {
+  std::array<std::atomic<uint64_t>, BigIntStats::kOperationCount> calls;
+  std::array<std::array<std::atomic<uint64_t>, BigIntStats::kSizeBuckets>,
+             BigIntStats::kOperationCount>
+      operand_sizes;
+  std::array<std::atomic<uint64_t>, BigIntStats::kTierCount> tiers;
+  std::atomic<uint64_t> bytes_allocated;
+};
+
+StatsCounters stats_counters;
+
+void RecordOperation(BigIntStats::Operation operation, std::size_t size) {
+  stats_counters.calls[operation].fetch_add(1, std::memory_order_relaxed);
+  std::size_t bucket = std::min<std::size_t>(std::bit_width(size),
+                                             BigIntStats::kSizeBuckets - 1);
+  stats_counters.operand_sizes[operation][bucket].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+void RecordTier(BigIntStats::Tier tier) {
+  stats_counters.tiers[tier].fetch_add(1, std::memory_order_relaxed);
+}
+}  // namespace
+
+BigIntStats BigIntStats::Snapshot() {
+  BigIntStats res;
+  for (std::size_t i = 0; i < kOperationCount; ++i) {
+    res.calls[i] = stats_counters.calls[i].load(std::memory_order_relaxed);
+    for (std::size_t j = 0; j < kSizeBuckets; ++j) {
+      res.operand_sizes[i][j] =
+          stats_counters.operand_sizes[i][j].load(std::memory_order_relaxed);
+    }
+  }
+  for (std::size_t i = 0; i < kTierCount; ++i) {
+    res.tiers[i] = stats_counters.tiers[i].load(std::memory_order_relaxed);
+  }
+  res.bytes_allocated =
+      stats_counters.bytes_allocated.load(std::memory_order_relaxed);
+  return res;
+}
+
+void BigIntStats::Reset() {
+  for (std::size_t i = 0; i < kOperationCount; ++i) {
+    stats_counters.calls[i].store(0, std::memory_order_relaxed);
+    for (std::size_t j = 0; j < kSizeBuckets; ++j) {
+      stats_counters.operand_sizes[i][j].store(0, std::memory_order_relaxed);
+    }
+  }
+  for (std::size_t i = 0; i < kTierCount; ++i) {
+    stats_counters.tiers[i].store(0, std::memory_order_relaxed);
+  }
+  stats_counters.bytes_allocated.store(0, std::memory_order_relaxed);
+}
+
+void BigIntStats::RecordAllocation(std::size_t bytes) {
+  stats_counters.bytes_allocated.fetch_add(bytes, std::memory_order_relaxed);
+}
+#else
+namespace {
+void RecordOperation(BigIntStats::Operation /*operation*/,
+                     std::size_t /*size*/) {}
+void RecordTier(BigIntStats::Tier /*tier*/) {}
+}  // namespace
+
+BigIntStats BigIntStats::Snapshot() { return BigIntStats(); }
+
+void BigIntStats::Reset() {}
+
+void BigIntStats::RecordAllocation(std::size_t /*bytes*/) {}
+#endif
+
+BigInt::BigInt() : is_positive_(true), digits_(1, 0) {}
+
 BigInt::BigInt(int64_t num) : BigInt(std::to_string(num)) {}
 
 BigInt::BigInt(const std::string& str) {
+  RecordOperation(BigIntStats::kParse, str.size());
   auto last = str.rend();
   if (str[0] == '-') {
     is_positive_ = false;
@@ -50,6 +130,8 @@ int64_t BigInt::GetRowsSum(const BigInt& rhs, bool addition, std::size_t i) {
 }
 
 BigInt& BigInt::operator+=(const BigInt& rhs) {
+  RecordOperation(BigIntStats::kAdd,
+                  std::max(digits_.size(), rhs.digits_.size()));
   if (!is_positive_ && rhs.is_positive_) {
     is_positive_ = true;
     *this = rhs - *this;
@@ -60,7 +142,7 @@ BigInt& BigInt::operator+=(const BigInt& rhs) {
     return *this;
   }
   int carry = 0;
-  digits_.reserve(std::max(digits_.size(), rhs.digits_.size()) + 1);
+  digits_.resize(std::max(digits_.size(), rhs.digits_.size()), 0);
   for (std::size_t i = 0; i < digits_.size(); i++) {
     int curr = GetRowsSum(rhs, true, i);
     curr += carry;
@@ -103,6 +185,8 @@ BigInt& BigInt::AbsSubstraction(const BigInt& rhs) {
 }
 
 BigInt& BigInt::operator-=(const BigInt& rhs) {
+  RecordOperation(BigIntStats::kSubtract,
+                  std::max(digits_.size(), rhs.digits_.size()));
   if (!is_positive_ && rhs.is_positive_) {
     is_positive_ = true;
     *this += rhs;
@@ -132,11 +216,31 @@ BigInt BigInt::operator-(const BigInt& rhs) const {
   return temp;
 }
 
+void BigInt::PropagateCarry(const std::vector<int>& column_sum) {
+  int carry = 0;
+  int curr = 0;
+  digits_.resize(column_sum.size());
+
+  for (std::size_t i = 0; i < column_sum.size(); i++) {
+    curr = column_sum[i] + carry;
+    digits_[i] = curr % kBase;
+    carry = curr / kBase;
+  }
+
+  RemoveZeros();
+}
+
 BigInt& BigInt::operator*=(const BigInt& rhs) {
+  if (&rhs == this) {
+    return Square();
+  }
+  RecordOperation(BigIntStats::kMultiply,
+                  std::max(digits_.size(), rhs.digits_.size()));
   if (*this == 0 || rhs == 0) {
     *this = 0;
     return *this;
   }
+  RecordTier(BigIntStats::kSchoolbookMultiplication);
   std::vector<int> column_sum(digits_.size() + rhs.digits_.size(), 0);
 
   for (std::size_t i = 0; i < digits_.size(); i++) {
@@ -145,17 +249,7 @@ BigInt& BigInt::operator*=(const BigInt& rhs) {
     }
   }
 
-  int carry = 0;
-  int curr = 0;
-  digits_.resize(column_sum.size());
-
-  for (std::size_t i = 0; i < column_sum.size(); i++) {
-    curr = column_sum[i] + carry;
-    digits_[i] = curr % kBase;
-    carry = curr / kBase;
-  }
-
-  RemoveZeros();
+  PropagateCarry(column_sum);
 
   is_positive_ = (is_positive_ == rhs.is_positive_);
   return *this;
@@ -163,15 +257,39 @@ BigInt& BigInt::operator*=(const BigInt& rhs) {
 
 BigInt BigInt::operator*(const BigInt& rhs) const {
   BigInt temp(*this);
+  if (&rhs == this) {
+    return temp.Square();
+  }
   temp *= rhs;
   return temp;
 }
 
+BigInt& BigInt::Square() {
+  RecordOperation(BigIntStats::kMultiply, digits_.size());
+  RecordTier(BigIntStats::kSchoolbookSquaring);
+  std::vector<int> column_sum(2 * digits_.size(), 0);
+
+  // every off-diagonal product d_i * d_j appears twice, so it is computed once
+  for (std::size_t i = 0; i < digits_.size(); i++) {
+    column_sum[2 * i] += digits_[i] * digits_[i];
+    int twice = 2 * digits_[i];
+    for (std::size_t j = i + 1; j < digits_.size(); j++) {
+      column_sum[i + j] += twice * digits_[j];
+    }
+  }
+
+  PropagateCarry(column_sum);
+
+  is_positive_ = true;
+  return *this;
+}
+
 void BigInt::Divide(const BigInt& rhs, bool is_module) {
+  RecordTier(BigIntStats::kLongDivision);
   int curr = 0;
   BigInt temp = 0;
   int i = digits_.size() - 1;
-  std::vector<int8_t> column_sum;
+  Digits column_sum;
 
   for (; temp * kBase + digits_[i] < rhs; --i) {
     temp *= kBase;
@@ -194,6 +312,14 @@ void BigInt::Divide(const BigInt& rhs, bool is_module) {
 }
 
 BigInt& BigInt::operator/=(const BigInt& rhs) {
+  if (rhs.FitsInWord()) {
+    DivSmall(rhs.ToWord());
+    if (!rhs.is_positive_) {
+      *this = -*this;
+    }
+    return *this;
+  }
+  RecordOperation(BigIntStats::kDivide, digits_.size());
   if (Abs() < rhs.Abs()) {
     *this = 0;
     return *this;
@@ -213,6 +339,10 @@ BigInt BigInt::operator/(const BigInt& rhs) const {
 }
 
 BigInt& BigInt::operator%=(const BigInt& rhs) {
+  if (rhs.FitsInWord()) {
+    return ModSmall(rhs.ToWord());
+  }
+  RecordOperation(BigIntStats::kModulo, digits_.size());
   bool new_sign = is_positive_;
   is_positive_ = true;
   if (*this < rhs.Abs()) {
@@ -222,7 +352,7 @@ BigInt& BigInt::operator%=(const BigInt& rhs) {
 
   Divide(rhs, true);
 
-  is_positive_ = new_sign;
+  is_positive_ = (new_sign || IsZero());
   return *this;
 }
 
@@ -232,6 +362,201 @@ BigInt BigInt::operator%(const BigInt& rhs) const {
   return temp;
 }
 
+void BigInt::MultiplyByWord(uint64_t factor) {
+  // factor <= kMaxWordFactor keeps digit * factor + carry below 2^64
+  uint64_t carry = 0;
+  for (auto& digit : digits_) {
+    carry += digit * factor;
+    digit = static_cast<int8_t>(carry % kBase);
+    carry /= kBase;
+  }
+  for (; carry != 0; carry /= kBase) {
+    digits_.push_back(static_cast<int8_t>(carry % kBase));
+  }
+  RemoveZeros();
+  if (IsZero()) {
+    is_positive_ = true;
+  }
+}
+
+uint64_t BigInt::DivideByWord(uint64_t divisor) {
+  RecordTier(BigIntStats::kWordDivision);
+  uint64_t rest = 0;
+  if (divisor <= std::numeric_limits<uint64_t>::max() / kBase) {
+    for (auto it = digits_.rbegin(); it != digits_.rend(); ++it) {
+      rest = rest * kBase + *it;
+      *it = static_cast<int8_t>(rest / divisor);
+      rest %= divisor;
+    }
+  } else {
+    // rest * kBase may overflow, but every quotient digit is still below kBase
+    for (auto it = digits_.rbegin(); it != digits_.rend(); ++it) {
+      unsigned __int128 curr =
+          static_cast<unsigned __int128>(rest) * kBase + *it;
+      *it = static_cast<int8_t>(curr / divisor);
+      rest = static_cast<uint64_t>(curr % divisor);
+    }
+  }
+  RemoveZeros();
+  if (IsZero()) {
+    is_positive_ = true;
+  }
+  return rest;
+}
+
+BigInt BigInt::Pow(const BigInt& base, uint64_t exp) {
+  RecordOperation(BigIntStats::kPower, base.digits_.size());
+  bool is_positive = (base.is_positive_ || exp % 2 == 0);
+  BigInt res = 1;
+  if (exp == 0) {
+    return res;
+  }
+  if (base.IsZero()) {
+    return base;
+  }
+
+  if (base.IsPowerOfBase()) {
+    RecordTier(BigIntStats::kShiftPower);
+    res.digits_.assign((base.digits_.size() - 1) * exp, 0);
+    res.digits_.push_back(1);
+    res.is_positive_ = is_positive;
+    return res;
+  }
+
+  if (base.FitsInWord()) {
+    // table[i] = |base|^i while it still fits a word factor; the result is
+    // built by linear passes with the largest entry, which beats squaring
+    // with the schoolbook multiplier at every length
+    RecordTier(BigIntStats::kWordTablePower);
+    std::vector<uint64_t> table = {1};
+    while (table.size() <= exp &&
+           table.back() <= kMaxWordFactor / base.ToWord()) {
+      table.push_back(table.back() * base.ToWord());
+    }
+    uint64_t step = table.size() - 1;
+    for (uint64_t i = 0; i < exp / step; ++i) {
+      res.MultiplyByWord(table[step]);
+    }
+    res.MultiplyByWord(table[exp % step]);
+    res.is_positive_ = is_positive;
+    return res;
+  }
+
+  RecordTier(BigIntStats::kSlidingWindowPower);
+  int bits = std::bit_width(exp);
+  int window = (bits > 24 ? 3 : (bits > 6 ? 2 : 1));
+  // odd_powers[i] = base^(2i + 1)
+  std::vector<BigInt> odd_powers = {base};
+  BigInt square = base * base;
+  for (int i = 1; i < (1 << (window - 1)); ++i) {
+    odd_powers.push_back(odd_powers.back() * square);
+  }
+
+  for (int i = bits - 1; i >= 0;) {
+    if ((exp >> i & 1) == 0) {
+      res.Square();
+      --i;
+      continue;
+    }
+    int j = std::max(i - window + 1, 0);
+    while ((exp >> j & 1) == 0) {
+      ++j;
+    }
+    for (int k = i; k >= j; --k) {
+      res.Square();
+    }
+    uint64_t value = (exp >> j) & ((uint64_t(1) << (i - j + 1)) - 1);
+    res *= odd_powers[value >> 1];
+    i = j - 1;
+  }
+  return res;
+}
+
+BigInt& BigInt::DivSmall(uint64_t divisor) {
+  RecordOperation(BigIntStats::kDivide, digits_.size());
+  DivideByWord(divisor);
+  return *this;
+}
+
+BigInt& BigInt::ModSmall(uint64_t divisor) {
+  RecordOperation(BigIntStats::kModulo, digits_.size());
+  bool new_sign = is_positive_;
+  uint64_t rest = DivideByWord(divisor);
+  digits_.clear();
+  for (; rest != 0; rest /= kBase) {
+    digits_.push_back(static_cast<int8_t>(rest % kBase));
+  }
+  if (digits_.empty()) {
+    digits_.push_back(0);
+    new_sign = true;
+  }
+  is_positive_ = new_sign;
+  return *this;
+}
+
+BigInt& BigInt::DivExact(const BigInt& rhs) {
+  RecordOperation(BigIntStats::kDivide, digits_.size());
+  bool new_sign = (is_positive_ == rhs.is_positive_);
+  BigInt divisor = rhs.Abs();
+
+  std::size_t zeros = 0;
+  while (divisor.digits_[zeros] == 0) {
+    ++zeros;
+  }
+  divisor.digits_.erase(divisor.digits_.begin(),
+                        divisor.digits_.begin() + zeros);
+  digits_.erase(digits_.begin(),
+                digits_.begin() + std::min(zeros, digits_.size() - 1));
+
+  // Hensel division needs the lowest divisor digit to be invertible mod kBase,
+  // so factors 2 and 5 are moved out of the divisor in word-sized batches
+  uint64_t factor = 1;
+  while (divisor.digits_[0] % 2 == 0 || divisor.digits_[0] % 5 == 0) {
+    uint64_t prime = (divisor.digits_[0] % 2 == 0 ? 2 : 5);
+    if (factor > std::numeric_limits<uint64_t>::max() / prime) {
+      DivideByWord(factor);
+      factor = 1;
+    }
+    divisor.DivideByWord(prime);
+    factor *= prime;
+  }
+  DivideByWord(factor);
+
+  if (divisor.FitsInWord()) {
+    DivideByWord(divisor.ToWord());
+  } else if (digits_.size() < divisor.digits_.size()) {
+    *this = 0;
+  } else {
+    RecordTier(BigIntStats::kExactDivision);
+    int64_t inverse = 1;
+    while (inverse * divisor.digits_[0] % kBase != 1) {
+      ++inverse;
+    }
+    std::size_t length = digits_.size() - divisor.digits_.size() + 1;
+    std::vector<int64_t> rest(digits_.begin(), digits_.begin() + length);
+    for (std::size_t i = 0; i < length; ++i) {
+      int64_t digit = rest[i] % kBase;
+      if (digit < 0) {
+        digit += kBase;
+      }
+      int64_t curr = digit * inverse % kBase;
+      for (std::size_t j = 1; j < divisor.digits_.size() && i + j < length;
+           ++j) {
+        rest[i + j] -= curr * divisor.digits_[j];
+      }
+      if (i + 1 < length) {
+        rest[i + 1] += (rest[i] - curr * divisor.digits_[0]) / kBase;
+      }
+      digits_[i] = static_cast<int8_t>(curr);
+    }
+    digits_.resize(length);
+    RemoveZeros();
+  }
+
+  is_positive_ = (new_sign || IsZero());
+  return *this;
+}
+
 BigInt& BigInt::operator++() {
   *this += 1;
   return *this;
@@ -255,6 +580,8 @@ BigInt BigInt::operator--(int) {
 }
 
 std::strong_ordering BigInt::operator<=>(const BigInt& rhs) const {
+  RecordOperation(BigIntStats::kCompare,
+                  std::max(digits_.size(), rhs.digits_.size()));
   if (!is_positive_ && rhs.is_positive_) {
     return std::strong_ordering::less;
   }
@@ -262,8 +589,8 @@ std::strong_ordering BigInt::operator<=>(const BigInt& rhs) const {
     return std::strong_ordering::greater;
   }
 
-  std::vector<int8_t> lhs_reversed = digits_;
-  std::vector<int8_t> rhs_reversed = rhs.digits_;
+  Digits lhs_reversed = digits_;
+  Digits rhs_reversed = rhs.digits_;
   std::reverse(lhs_reversed.begin(), lhs_reversed.end());
   std::reverse(rhs_reversed.begin(), rhs_reversed.end());
 
@@ -287,6 +614,35 @@ BigInt BigInt::operator-() const {
   return res;
 }
 
+bool BigInt::IsZero() const {
+  return digits_.size() == 1 && digits_[0] == 0;
+}
+
+bool BigInt::IsPowerOfBase() const {
+  return digits_.back() == 1 &&
+         std::all_of(digits_.begin(), digits_.end() - 1,
+                     [](int8_t digit) { return digit == 0; });
+}
+
+bool BigInt::FitsInWord() const { return digits_.size() <= kWordDigits; }
+
+uint64_t BigInt::ToWord() const {
+  uint64_t res = 0;
+  for (auto it = digits_.rbegin(); it != digits_.rend(); ++it) {
+    res = res * kBase + *it;
+  }
+  return res;
+}
+
+void BigInt::ShiftRight(std::size_t count) {
+  digits_.erase(digits_.begin(),
+                digits_.begin() + std::min(count, digits_.size()));
+  if (digits_.empty()) {
+    digits_.push_back(0);
+    is_positive_ = true;
+  }
+}
+
 BigInt BigInt::Abs() const {
   BigInt res(*this);
   res.is_positive_ = true;
@@ -294,6 +650,7 @@ BigInt BigInt::Abs() const {
 }
 
 std::ostream& operator<<(std::ostream& out, const BigInt& rhs) {
+  RecordOperation(BigIntStats::kPrint, rhs.digits_.size());
   if (!rhs.is_positive_) {
     out << '-';
   }
@@ -304,8 +661,124 @@ std::ostream& operator<<(std::ostream& out, const BigInt& rhs) {
 }
 
 std::istream& operator>>(std::istream& in, BigInt& rhs) {
-  std::string str;
-  in >> str;
-  rhs = BigInt(str);
+  std::istream::sentry sentry(in);
+  if (!sentry) {
+    return in;
+  }
+  // digits go straight from the stream buffer into the result, so no
+  // intermediate token string is kept alive next to it
+  std::streambuf* buffer = in.rdbuf();
+  BigInt::Digits digits;
+  bool is_positive = true;
+  auto curr = buffer->sgetc();
+  if (curr == '-') {
+    is_positive = false;
+    curr = buffer->snextc();
+  }
+  for (; curr >= '0' && curr <= '9'; curr = buffer->snextc()) {
+    digits.push_back(static_cast<int8_t>(curr - '0'));
+  }
+  if (std::char_traits<char>::eq_int_type(curr,
+                                          std::char_traits<char>::eof())) {
+    in.setstate(std::ios_base::eofbit);
+  }
+  if (digits.empty()) {
+    in.setstate(std::ios_base::failbit);
+    return in;
+  }
+
+  std::reverse(digits.begin(), digits.end());
+  RecordOperation(BigIntStats::kParse, digits.size());
+  rhs.digits_.swap(digits);
+  rhs.is_positive_ = is_positive;
+  rhs.RemoveZeros();
+  if (rhs.IsZero()) {
+    rhs.is_positive_ = true;
+  }
   return in;
 }
+
+BarrettReducer::BarrettReducer(const BigInt& modulus)
+    : modulus_(modulus.Abs()),
+      length_(modulus_.digits_.size()),
+      word_divisor_(0),
+      word_reciprocal_(0),
+      word_shift_(0) {
+  if (modulus_.FitsInWord()) {
+    // Moller-Granlund reciprocal of the normalized divisor
+    word_shift_ = std::countl_zero(modulus_.ToWord());
+    word_divisor_ = modulus_.ToWord() << word_shift_;
+    word_reciprocal_ = static_cast<uint64_t>(
+        ~static_cast<unsigned __int128>(0) / word_divisor_);
+    return;
+  }
+  BigInt power = 0;
+  power.digits_.assign(2 * length_, 0);
+  power.digits_.push_back(1);
+  reciprocal_ = power / modulus_;
+}
+
+uint64_t BarrettReducer::ReduceWord(unsigned __int128 num) const {
+  num <<= word_shift_;
+  uint64_t low = static_cast<uint64_t>(num);
+  unsigned __int128 quotient =
+      static_cast<unsigned __int128>(word_reciprocal_) * (num >> 64) + num;
+  uint64_t quotient_high = static_cast<uint64_t>(quotient >> 64) + 1;
+  uint64_t rest = low - quotient_high * word_divisor_;
+  if (rest > static_cast<uint64_t>(quotient)) {
+    rest += word_divisor_;
+  }
+  if (rest >= word_divisor_) {
+    rest -= word_divisor_;
+  }
+  return rest >> word_shift_;
+}
+
+void BarrettReducer::ReduceDoubleLength(BigInt& num) const {
+  BigInt quotient = num;
+  quotient.ShiftRight(length_ - 1);
+  quotient *= reciprocal_;
+  quotient.ShiftRight(length_ + 1);
+  num -= quotient * modulus_;
+  while (num >= modulus_) {
+    num -= modulus_;
+  }
+}
+
+BigInt BarrettReducer::Reduce(const BigInt& num) const {
+  RecordOperation(BigIntStats::kModulo, num.digits_.size());
+  BigInt res = 0;
+  std::size_t chunk_length =
+      (modulus_.FitsInWord() ? BigInt::kWordDigits : length_);
+  std::size_t i = num.digits_.size();
+  std::size_t take = (i % chunk_length == 0 ? chunk_length : i % chunk_length);
+
+  if (modulus_.FitsInWord()) {
+    RecordTier(BigIntStats::kWordBarrettReduction);
+    uint64_t rest = 0;
+    for (; i > 0; take = chunk_length) {
+      uint64_t chunk = 0;
+      uint64_t scale = 1;
+      for (std::size_t j = 0; j < take; ++j) {
+        chunk = chunk * BigInt::kBase + num.digits_[--i];
+        scale *= BigInt::kBase;
+      }
+      rest = ReduceWord(static_cast<unsigned __int128>(rest) * scale + chunk);
+    }
+    res = static_cast<int64_t>(rest);
+  } else {
+    RecordTier(BigIntStats::kBarrettReduction);
+    for (; i > 0; take = chunk_length) {
+      i -= take;
+      res.digits_.insert(res.digits_.begin(), num.digits_.begin() + i,
+                         num.digits_.begin() + i + take);
+      res.RemoveZeros();
+      ReduceDoubleLength(res);
+    }
+  }
+
+  if (!res.IsZero()) {
+    res.is_positive_ = num.is_positive_;
+  }
+  return res;
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <compare>
 #include <cstdint>
 #include <iostream>
@@ -8,9 +10,72 @@
 #include <string>
 #include <vector>
 
+// Per-operation counters, compiled in only with -DBIGINT_STATS; without it
+// Snapshot() returns zeros and the recording calls are empty.
+struct BigIntStats {
+  enum Operation {
+    kAdd,
+    kSubtract,
+    kMultiply,
+    kDivide,
+    kModulo,
+    kCompare,
+    kParse,
+    kPrint,
+    kPower,
+    kOperationCount
+  };
+  enum Tier {
+    kSchoolbookMultiplication,
+    kSchoolbookSquaring,
+    kWordDivision,
+    kLongDivision,
+    kExactDivision,
+    kBarrettReduction,
+    kWordBarrettReduction,
+    kShiftPower,
+    kWordTablePower,
+    kSlidingWindowPower,
+    kTierCount
+  };
+  // bucket i holds operands with bit_width(digit count) == i
+  static const std::size_t kSizeBuckets = 33;
+
+  std::array<uint64_t, kOperationCount> calls{};
+  std::array<std::array<uint64_t, kSizeBuckets>, kOperationCount>
+      operand_sizes{};
+  std::array<uint64_t, kTierCount> tiers{};
+  uint64_t bytes_allocated = 0;
+
+  static BigIntStats Snapshot();
+  static void Reset();
+  static void RecordAllocation(std::size_t bytes);
+};
+
+template <typename T>
+struct CountingAllocator {
+  using value_type = T;
+
+  CountingAllocator() = default;
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U>& /*other*/) {}
+
+  T* allocate(std::size_t count) {
+    BigIntStats::RecordAllocation(count * sizeof(T));
+    return std::allocator<T>().allocate(count);
+  }
+  void deallocate(T* ptr, std::size_t count) {
+    std::allocator<T>().deallocate(ptr, count);
+  }
+
+  bool operator==(const CountingAllocator& rhs) const = default;
+};
+
 class BigInt {
  public:
-  BigInt() = default;
+  // Zero, so that BigInt() can stand for the additive identity in generic
+  // code (Matrix<N, M, BigInt> zero-initializes with T()).
+  BigInt();
   BigInt(int64_t num);
   BigInt(const std::string& str);
   BigInt(const BigInt& other);
@@ -42,19 +107,61 @@ class BigInt {
 
   BigInt operator-() const;
 
+  BigInt& Square();
+  static BigInt Pow(const BigInt& base, uint64_t exp);
+  BigInt& DivSmall(uint64_t divisor);
+  BigInt& ModSmall(uint64_t divisor);
+  BigInt& DivExact(const BigInt& rhs);
+
   friend std::ostream& operator<<(std::ostream& out, const BigInt& rhs);
   friend std::istream& operator>>(std::istream& in, BigInt& rhs);
 
+  friend class BarrettReducer;
+
  private:
   int64_t GetRowsSum(const BigInt& rhs, bool addition, std::size_t i);
   BigInt& AbsSubstraction(const BigInt& rhs);
   BigInt Abs() const;
   void ReverseBothDigits(const BigInt& rhs);
   void RemoveZeros();
+  void PropagateCarry(const std::vector<int>& column_sum);
   void Divide(const BigInt& rhs, bool is_module);
+  uint64_t DivideByWord(uint64_t divisor);
+  void MultiplyByWord(uint64_t factor);
+  bool IsPowerOfBase() const;
+  bool IsZero() const;
+  bool FitsInWord() const;
+  uint64_t ToWord() const;
+  void ShiftRight(std::size_t count);
+
+#ifdef BIGINT_STATS
+  using Digits = std::vector<int8_t, CountingAllocator<int8_t>>;
+#else
+  using Digits = std::vector<int8_t>;
+#endif
 
   bool is_positive_;
-  std::vector<int8_t> digits_;
+  Digits digits_;
   static const int8_t kBase = 10;
+  static const std::size_t kWordDigits = 18;
+  static const uint64_t kMaxWordFactor = 1'000'000'000'000'000'000;
   static const std::string kInt64MinStr;
 };
+
+class BarrettReducer {
+ public:
+  explicit BarrettReducer(const BigInt& modulus);
+
+  BigInt Reduce(const BigInt& num) const;
+
+ private:
+  void ReduceDoubleLength(BigInt& num) const;
+  uint64_t ReduceWord(unsigned __int128 num) const;
+
+  BigInt modulus_;
+  BigInt reciprocal_;
+  std::size_t length_;
+  uint64_t word_divisor_;
+  uint64_t word_reciprocal_;
+  int word_shift_;
+};
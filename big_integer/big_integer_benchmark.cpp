@@ -0,0 +1,220 @@
+// Build with Google Benchmark installed:
+//   g++ -std=c++20 -O2 big_integer.cpp big_integer_benchmark.cpp
+//       -lbenchmark -lpthread -o big_integer_benchmark
+// Results for tracking go to JSON:
+//   ./big_integer_benchmark --benchmark_out=bench_output.json
+//       --benchmark_out_format=json
+//
+// The argument of every benchmark is the number of decimal digits in each
+// operand. Quadratic operations stop at 10^4 digits, the rest go to 10^6;
+// division by a multi-word divisor starts at 21 digits.
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "big_integer.hpp"
+
+namespace {
+
+const int64_t kMinDigits = 1;
+const int64_t kMaxLinearDigits = 1'000'000;
+const int64_t kMaxQuadraticDigits = 10'000;
+// Every number this long is above 2^64, so division benchmarks starting here
+// never take the single-word path, which BmDivideByWord covers.
+const int64_t kMinMultiWordDigits = 21;
+
+std::string MakeDigits(int64_t length, uint64_t seed) {
+  std::mt19937_64 generator(seed);
+  std::string str(length, '0');
+  str[0] = static_cast<char>('1' + generator() % 9);
+  for (int64_t i = 1; i < length; ++i) {
+    str[i] = static_cast<char>('0' + generator() % 10);
+  }
+  return str;
+}
+
+BigInt MakeNumber(int64_t length, uint64_t seed) {
+  return BigInt(MakeDigits(length, seed));
+}
+
+void BmAdd(benchmark::State& state) {
+  BigInt lhs = MakeNumber(state.range(0), 1);
+  BigInt rhs = MakeNumber(state.range(0), 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs + rhs);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmSubtract(benchmark::State& state) {
+  BigInt lhs = MakeNumber(state.range(0), 1);
+  BigInt rhs = MakeNumber(state.range(0), 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs - rhs);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmMultiply(benchmark::State& state) {
+  BigInt lhs = MakeNumber(state.range(0), 1);
+  BigInt rhs = MakeNumber(state.range(0), 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs * rhs);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmSquare(benchmark::State& state) {
+  BigInt num = MakeNumber(state.range(0), 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(num * num);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmPow(benchmark::State& state) {
+  // a 20-digit base does not fit a word, so this exercises sliding windows
+  BigInt base = MakeNumber(20, 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(BigInt::Pow(base, state.range(0)));
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmDivide(benchmark::State& state) {
+  BigInt lhs = MakeNumber(2 * state.range(0), 1);
+  BigInt rhs = MakeNumber(state.range(0), 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs / rhs);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmModulo(benchmark::State& state) {
+  BigInt lhs = MakeNumber(2 * state.range(0), 1);
+  BigInt rhs = MakeNumber(state.range(0), 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs % rhs);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmDivideByWord(benchmark::State& state) {
+  BigInt lhs = MakeNumber(state.range(0), 1);
+  BigInt rhs = 1'000'000'007;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs / rhs);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmModuloByWord(benchmark::State& state) {
+  BigInt lhs = MakeNumber(state.range(0), 1);
+  BigInt rhs = 1'000'000'007;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs % rhs);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmCompare(benchmark::State& state) {
+  // equal lengths and a shared prefix force a full scan
+  BigInt lhs = MakeNumber(state.range(0), 1);
+  BigInt rhs = lhs + 1;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lhs < rhs);
+  }
+  state.SetComplexityN(state.range(0));
+}
+
+void BmConstructFromString(benchmark::State& state) {
+  std::string str = MakeDigits(state.range(0), 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(BigInt(str));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetComplexityN(state.range(0));
+}
+
+void BmRead(benchmark::State& state) {
+  std::string str = MakeDigits(state.range(0), 1);
+  for (auto _ : state) {
+    std::istringstream in(str);
+    BigInt num;
+    in >> num;
+    benchmark::DoNotOptimize(num);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetComplexityN(state.range(0));
+}
+
+void BmPrint(benchmark::State& state) {
+  BigInt num = MakeNumber(state.range(0), 1);
+  for (auto _ : state) {
+    std::ostringstream out;
+    out << num;
+    benchmark::DoNotOptimize(out.str());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.SetComplexityN(state.range(0));
+}
+
+}  // namespace
+
+BENCHMARK(BmAdd)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxLinearDigits)
+    ->Complexity(benchmark::oN);
+BENCHMARK(BmSubtract)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxLinearDigits)
+    ->Complexity(benchmark::oN);
+BENCHMARK(BmMultiply)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxQuadraticDigits)
+    ->Complexity(benchmark::oNSquared);
+BENCHMARK(BmSquare)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxQuadraticDigits)
+    ->Complexity(benchmark::oNSquared);
+BENCHMARK(BmPow)
+    ->RangeMultiplier(10)
+    ->Range(1, kMaxQuadraticDigits / 20)
+    ->Complexity(benchmark::oNSquared);
+BENCHMARK(BmDivide)
+    ->RangeMultiplier(10)
+    ->Range(kMinMultiWordDigits, kMaxQuadraticDigits)
+    ->Complexity(benchmark::oNSquared);
+BENCHMARK(BmModulo)
+    ->RangeMultiplier(10)
+    ->Range(kMinMultiWordDigits, kMaxQuadraticDigits)
+    ->Complexity(benchmark::oNSquared);
+BENCHMARK(BmDivideByWord)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxLinearDigits)
+    ->Complexity(benchmark::oN);
+BENCHMARK(BmModuloByWord)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxLinearDigits)
+    ->Complexity(benchmark::oN);
+BENCHMARK(BmCompare)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxLinearDigits)
+    ->Complexity(benchmark::oN);
+BENCHMARK(BmConstructFromString)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxLinearDigits)
+    ->Complexity(benchmark::oN);
+BENCHMARK(BmRead)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxLinearDigits)
+    ->Complexity(benchmark::oN);
+BENCHMARK(BmPrint)
+    ->RangeMultiplier(10)
+    ->Range(kMinDigits, kMaxLinearDigits)
+    ->Complexity(benchmark::oN);
+
+BENCHMARK_MAIN();
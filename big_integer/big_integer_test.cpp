@@ -0,0 +1,304 @@
+// Build and run:
+//   g++ -std=c++20 -O2 -Wall -Wextra big_integer_test.cpp big_integer.cpp
+//       -o big_integer_test && ./big_integer_test
+// Every check is an assert, so build without NDEBUG. With -DBIGINT_STATS
+// the tests also check which tier each fast path went through.
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "big_integer.hpp"
+
+namespace {
+
+// A number of exactly digits decimal digits (no leading zero), negative
+// with probability one half if negative is set, the same on every run.
+BigInt RandomBigInt(std::mt19937_64& random, std::size_t digits,
+                    bool negative = true) {
+  std::string str;
+  if (negative && random() % 2 == 0) {
+    str += '-';
+  }
+  str += static_cast<char>('1' + random() % 9);
+  for (std::size_t i = 1; i < digits; ++i) {
+    str += static_cast<char>('0' + random() % 10);
+  }
+  return BigInt(str);
+}
+
+BigInt Magnitude(const BigInt& num) { return num < 0 ? -num : num; }
+
+std::size_t DigitCount(const BigInt& num) {
+  std::ostringstream out;
+  out << Magnitude(num);
+  return out.str().size();
+}
+
+// 10^exponent, built without Pow so that it can check Pow
+BigInt PowerOfTen(std::size_t exponent) {
+  return BigInt("1" + std::string(exponent, '0'));
+}
+
+// With -DBIGINT_STATS, that the calls since the last Reset() went through
+// tier; without it the counters stay at zero and there is nothing to check.
+void ExpectTier(BigIntStats::Tier tier) {
+#ifdef BIGINT_STATS
+  assert(BigIntStats::Snapshot().tiers[tier] > 0);
+#else
+  (void)tier;
+#endif
+  BigIntStats::Reset();
+}
+
+// Quotient and remainder by a word truncate toward zero: the remainder has
+// the sign of the dividend and is smaller than the divisor, and operator/
+// and operator% agree with DivSmall and ModSmall wherever the divisor fits
+// them.
+void CheckWordDivision(const BigInt& dividend, uint64_t divisor) {
+  BigInt quotient = dividend;
+  quotient.DivSmall(divisor);
+  BigInt remainder = dividend;
+  remainder.ModSmall(divisor);
+
+  BigInt wide_divisor(std::to_string(divisor));
+  assert(quotient * wide_divisor + remainder == dividend);
+  assert(Magnitude(remainder) < wide_divisor);
+  assert(remainder == 0 || (remainder < 0) == (dividend < 0));
+  if (divisor < 1'000'000'000'000'000'000) {
+    assert(dividend / wide_divisor == quotient);
+    assert(dividend % wide_divisor == remainder);
+    assert(dividend / -wide_divisor == -quotient);
+  }
+}
+
+// dividend = quotient * divisor must come back out of DivExact for every
+// sign combination, and agree with operator/ for a positive divisor.
+void CheckExactDivision(const BigInt& quotient, const BigInt& divisor) {
+  BigInt dividend = quotient * divisor;
+  for (int sign = 0; sign < 4; ++sign) {
+    BigInt signed_dividend = (sign & 1) != 0 ? -dividend : dividend;
+    BigInt signed_divisor = (sign & 2) != 0 ? -divisor : divisor;
+    BigInt expected = (sign == 1 || sign == 2) ? -quotient : quotient;
+    BigInt result = signed_dividend;
+    result.DivExact(signed_divisor);
+    assert(result == expected);
+  }
+  if (divisor > 0) {
+    assert(dividend / divisor == quotient);
+  }
+}
+
+void TestDivision() {
+  std::mt19937_64 random(26);
+  // words on both sides of 10^k, 2^k and of max / kBase, where the word
+  // division switches to 128-bit steps
+  std::vector<uint64_t> divisors = {1,
+                                    2,
+                                    3,
+                                    7,
+                                    9,
+                                    10,
+                                    11,
+                                    999'999'999,
+                                    1'000'000'000,
+                                    (uint64_t(1) << 32) - 1,
+                                    uint64_t(1) << 32,
+                                    999'999'999'999'999'999,
+                                    1'000'000'000'000'000'000,
+                                    1'000'000'000'000'000'001,
+                                    UINT64_MAX / 10,
+                                    UINT64_MAX / 10 + 1,
+                                    UINT64_MAX - 1,
+                                    UINT64_MAX};
+  for (int i = 0; i < 20; ++i) {
+    divisors.push_back(random() >> (random() % 64));
+  }
+  std::vector<BigInt> dividends = {0, 1, -1, 9, -10};
+  for (std::size_t digits : {1, 2, 17, 18, 19, 20, 36, 37, 100, 300}) {
+    for (int i = 0; i < 3; ++i) {
+      dividends.push_back(RandomBigInt(random, digits));
+    }
+    dividends.push_back(PowerOfTen(digits));
+    dividends.push_back(-(PowerOfTen(digits) - 1));
+  }
+  for (uint64_t divisor : divisors) {
+    if (divisor == 0) {
+      continue;
+    }
+    for (const BigInt& dividend : dividends) {
+      CheckWordDivision(dividend, divisor);
+    }
+    // a multiple of the divisor leaves no remainder
+    BigInt multiple =
+        RandomBigInt(random, 40) * BigInt(std::to_string(divisor));
+    BigInt remainder = multiple;
+    assert(remainder.ModSmall(divisor) == 0);
+  }
+
+  // divisors of one word and of several, some made of factors 2 and 5 that
+  // DivExact strips before the Hensel steps, and trailing zeros
+  for (std::size_t divisor_digits : {1, 5, 18, 19, 25, 60}) {
+    for (std::size_t quotient_digits : {1, 2, 18, 19, 40, 120}) {
+      for (int i = 0; i < 3; ++i) {
+        BigInt divisor = RandomBigInt(random, divisor_digits, false);
+        BigInt quotient = RandomBigInt(random, quotient_digits);
+        CheckExactDivision(quotient, divisor);
+        CheckExactDivision(quotient, divisor * PowerOfTen(i * 7));
+        CheckExactDivision(quotient, divisor * BigInt(1 << (20 + i)));
+        CheckExactDivision(quotient, divisor * BigInt(1'220'703'125));  // 5^13
+      }
+    }
+    CheckExactDivision(0, RandomBigInt(random, divisor_digits, false));
+  }
+  CheckExactDivision(RandomBigInt(random, 50), 1);
+  BigInt power_of_two("1180591620717411303424");  // 2^70
+  CheckExactDivision(RandomBigInt(random, 50), power_of_two);
+  CheckExactDivision(RandomBigInt(random, 50), power_of_two * PowerOfTen(30));
+
+  BigInt wide_divisor = RandomBigInt(random, 30, false) * 10 + 3;
+  BigInt wide_product = RandomBigInt(random, 80) * wide_divisor;
+  BigIntStats::Reset();
+  wide_product.DivExact(wide_divisor);
+  ExpectTier(BigIntStats::kExactDivision);
+}
+
+// Reduce gives the remainder operator% does, with the sign of num, for a
+// modulus of either sign; that remainder leaves an exact multiple behind.
+void CheckReduction(const BarrettReducer& reducer,
+                    const BarrettReducer& negated, const BigInt& num,
+                    const BigInt& modulus) {
+  BigInt remainder = reducer.Reduce(num);
+  assert(remainder == num % modulus);
+  assert(negated.Reduce(num) == remainder);
+  assert(Magnitude(remainder) < modulus);
+  assert(remainder == 0 || (remainder < 0) == (num < 0));
+  BigInt multiple = num - remainder;
+  BigInt quotient = multiple;
+  quotient.DivExact(modulus);
+  assert(quotient * modulus == multiple);
+}
+
+// Moduli of up to 18 digits take the word path with a normalized
+// reciprocal, longer ones the multi-word path; numbers run from below the
+// modulus to several times its length, so that both paths reduce many
+// chunks.
+void TestBarrett() {
+  std::mt19937_64 random(27);
+  std::vector<BigInt> moduli = {1,
+                                2,
+                                3,
+                                7,
+                                10,
+                                4'294'967'295,
+                                4'294'967'296,
+                                PowerOfTen(17),
+                                PowerOfTen(18) - 1,
+                                PowerOfTen(18),
+                                PowerOfTen(18) + 1,
+                                PowerOfTen(30),
+                                PowerOfTen(36) - 1};
+  for (std::size_t digits : {1, 9, 17, 18, 19, 20, 37, 60}) {
+    for (int i = 0; i < 3; ++i) {
+      moduli.push_back(RandomBigInt(random, digits, false));
+    }
+  }
+  for (const BigInt& modulus : moduli) {
+    BarrettReducer reducer(modulus);
+    BarrettReducer negated(-modulus);
+    BigIntStats::Reset();
+    reducer.Reduce(modulus + 1);
+    ExpectTier(modulus < PowerOfTen(18) ? BigIntStats::kWordBarrettReduction
+                                        : BigIntStats::kBarrettReduction);
+
+    std::vector<BigInt> nums = {0, 1, -1, modulus - 1, modulus, modulus + 1,
+                                -modulus, modulus * modulus - 1,
+                                modulus * modulus};
+    std::size_t length = DigitCount(modulus);
+    for (std::size_t digits :
+         {std::size_t(1), length, length + 1, 2 * length, 2 * length + 1,
+          3 * length + 5, std::size_t(200)}) {
+      for (int i = 0; i < 3; ++i) {
+        nums.push_back(RandomBigInt(random, digits));
+      }
+      BigInt multiple = RandomBigInt(random, digits) * modulus;
+      nums.push_back(multiple);
+      nums.push_back(multiple - 1);
+    }
+    for (const BigInt& num : nums) {
+      CheckReduction(reducer, negated, num, modulus);
+    }
+  }
+}
+
+// base^exp for every exp in exponents, against repeated multiplication,
+// each through the expected tier
+void CheckPow(const BigInt& base, const std::vector<uint64_t>& exponents,
+              BigIntStats::Tier tier) {
+  for (uint64_t exp : exponents) {
+    BigInt expected = 1;
+    for (uint64_t i = 0; i < exp; ++i) {
+      expected *= base;
+    }
+    BigIntStats::Reset();
+    BigInt power = BigInt::Pow(base, exp);
+    if (exp != 0) {
+      ExpectTier(tier);
+    }
+    assert(power == expected);
+  }
+}
+
+// Each tier with exponents 0 and 1 and with the exponents where it changes
+// step: the table length of the word table (one entry for bases above
+// 10^9, 59 for base 2) and the window width of the sliding window (one bit
+// up to exponent 63, two bits from 64 on). The three-bit window starts at
+// exponent 2^24, too large for a multi-word base to check here.
+void TestPow() {
+  std::mt19937_64 random(32);
+  std::vector<uint64_t> exponents = {0, 1, 2, 3, 7, 40};
+
+  for (const BigInt& base :
+       {BigInt(1), BigInt(-1), BigInt(10), BigInt(-10), PowerOfTen(25),
+        -PowerOfTen(18)}) {
+    CheckPow(base, exponents, BigIntStats::kShiftPower);
+  }
+  CheckPow(PowerOfTen(3), {999, 1000, 1001}, BigIntStats::kShiftPower);
+
+  CheckPow(2, {58, 59, 60, 117, 118, 119, 300}, BigIntStats::kWordTablePower);
+  CheckPow(-3, {36, 37, 38, 39, 75, 76, 301}, BigIntStats::kWordTablePower);
+  CheckPow(999'999'999, {1, 2, 3, 4, 5, 41}, BigIntStats::kWordTablePower);
+  CheckPow(1'000'000'001, {1, 2, 3, 4, 5}, BigIntStats::kWordTablePower);
+  for (const BigInt& base :
+       {BigInt(-7), PowerOfTen(17) + 3, PowerOfTen(18) - 1,
+        -(PowerOfTen(18) - 1), RandomBigInt(random, 12)}) {
+    CheckPow(base, exponents, BigIntStats::kWordTablePower);
+  }
+
+  std::vector<uint64_t> window_exponents = {0,  1,  2,  3,   5,   62,
+                                            63, 64, 65, 127, 128, 200};
+  for (const BigInt& base :
+       {PowerOfTen(18) + 1, -(PowerOfTen(18) + 7), RandomBigInt(random, 19),
+        RandomBigInt(random, 40)}) {
+    CheckPow(base, window_exponents, BigIntStats::kSlidingWindowPower);
+  }
+
+  assert(BigInt::Pow(0, 0) == 1);
+  assert(BigInt::Pow(0, 1) == 0);
+  assert(BigInt::Pow(0, 77) == 0);
+  assert(BigInt::Pow(-2, 63) == -BigInt("9223372036854775808"));
+}
+
+}  // namespace
+
+int main() {
+  TestDivision();
+  TestBarrett();
+  TestPow();
+  std::puts("all tests passed");
+}
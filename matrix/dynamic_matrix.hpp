@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "kernels.hpp"
+#include "matrix.hpp"
+
+// Heap-backed counterpart of Matrix for shapes known only at run time. The
+// elements live in one cache-line aligned row-major block and go through the
+// same kernels as Matrix; mismatched shapes throw std::invalid_argument.
+template <typename T = int64_t>
+class DynamicMatrix {
+ public:
+  DynamicMatrix(std::size_t rows, std::size_t columns)
+      : rows_(rows), columns_(columns), buffer_(rows * columns, T()) {}
+
+  DynamicMatrix(std::size_t rows, std::size_t columns, const T& elem)
+      : rows_(rows), columns_(columns), buffer_(rows * columns, elem) {}
+
+  DynamicMatrix(const std::vector<std::vector<T>>& data)
+      : rows_(data.size()), columns_(data.empty() ? 0 : data[0].size()) {
+    buffer_.reserve(rows_ * columns_);
+    for (const auto& row : data) {
+      if (row.size() != columns_) {
+        throw std::invalid_argument("DynamicMatrix: jagged rows");
+      }
+      buffer_.insert(buffer_.end(), row.begin(), row.end());
+    }
+  }
+
+  template <std::size_t N, std::size_t M, typename Layout>
+  DynamicMatrix(const Matrix<N, M, T, Layout>& matrix) : rows_(N), columns_(M) {
+    buffer_.reserve(N * M);
+    for (std::size_t i = 0; i < N; ++i) {
+      for (std::size_t j = 0; j < M; ++j) {
+        buffer_.push_back(matrix(i, j));
+      }
+    }
+  }
+
+  ~DynamicMatrix() = default;
+
+  std::size_t Rows() const { return rows_; }
+  std::size_t Columns() const { return columns_; }
+
+  T* Data() { return buffer_.data(); }
+  const T* Data() const { return buffer_.data(); }
+
+  DynamicMatrix& operator+=(const DynamicMatrix& other) {
+    CheckSameShape(other);
+    utils::AddTo(buffer_.data(), other.buffer_.data(), buffer_.size());
+    return *this;
+  }
+
+  DynamicMatrix& operator-=(const DynamicMatrix& other) {
+    CheckSameShape(other);
+    utils::SubtractFrom(buffer_.data(), other.buffer_.data(), buffer_.size());
+    return *this;
+  }
+
+  DynamicMatrix operator+(const DynamicMatrix& other) const {
+    DynamicMatrix result(*this);
+    result += other;
+    return result;
+  }
+
+  DynamicMatrix operator-(const DynamicMatrix& other) const {
+    DynamicMatrix result(*this);
+    result -= other;
+    return result;
+  }
+
+  DynamicMatrix& operator*=(const T& other) {
+    utils::ScaleBy(buffer_.data(), other, buffer_.size());
+    return *this;
+  }
+
+  DynamicMatrix operator*(const T& other) const {
+    DynamicMatrix result(*this);
+    result *= other;
+    return result;
+  }
+
+  friend DynamicMatrix operator*(const DynamicMatrix& left,
+                                 const DynamicMatrix& right) {
+    if (left.columns_ != right.rows_) {
+      throw std::invalid_argument("DynamicMatrix: inner dimensions differ");
+    }
+    DynamicMatrix result(left.rows_, right.columns_);
+    utils::Multiply(left, right, result, left.rows_, left.columns_,
+                    right.columns_);
+    return result;
+  }
+
+  DynamicMatrix Transposed() const {
+    DynamicMatrix result(columns_, rows_);
+    utils::Transpose(
+        [this](std::size_t row) { return buffer_.data() + row * columns_; },
+        [&result](std::size_t row) { return &result(row, 0); }, rows_,
+        columns_);
+    return result;
+  }
+
+  void TransposeInPlace() {
+    if (rows_ != columns_) {
+      throw std::invalid_argument("DynamicMatrix: in-place transpose of a "
+                                  "non-square");
+    }
+    utils::TransposeInPlace(
+        [this](std::size_t row) { return buffer_.data() + row * columns_; },
+        rows_);
+  }
+
+  T Trace() const {
+    if (rows_ != columns_) {
+      throw std::invalid_argument("DynamicMatrix: trace of a non-square");
+    }
+    T result = T();
+    for (std::size_t i = 0; i < rows_; ++i) {
+      result += (*this)(i, i);
+    }
+    return result;
+  }
+
+  T& operator()(std::size_t row, std::size_t column) {
+    return buffer_[row * columns_ + column];
+  }
+  const T& operator()(std::size_t row, std::size_t column) const {
+    return buffer_[row * columns_ + column];
+  }
+
+  bool operator==(const DynamicMatrix& other) const {
+    return rows_ == other.rows_ && columns_ == other.columns_ &&
+           buffer_ == other.buffer_;
+  }
+
+ private:
+  void CheckSameShape(const DynamicMatrix& other) const {
+    if (rows_ != other.rows_ || columns_ != other.columns_) {
+      throw std::invalid_argument("DynamicMatrix: shapes differ");
+    }
+  }
+
+  std::size_t rows_;
+  std::size_t columns_;
+  utils::AlignedVector<T> buffer_;
+};
+
+// Product in Semiring (see semiring.hpp), as Multiply<Semiring> for Matrix.
+template <typename Semiring = PlusTimes, typename T>
+DynamicMatrix<T> Multiply(const DynamicMatrix<T>& left,
+                          const DynamicMatrix<T>& right) {
+  if (left.Columns() != right.Rows()) {
+    throw std::invalid_argument("DynamicMatrix: inner dimensions differ");
+  }
+  DynamicMatrix<T> result(left.Rows(), right.Columns(),
+                          Semiring::template Zero<T>());
+  utils::Multiply<Semiring>(left, right, result, left.Rows(), left.Columns(),
+                            right.Columns());
+  return result;
+}
+
+template <typename Semiring = PlusTimes, typename T>
+DynamicMatrix<T> Multiply(const DynamicMatrix<T>& left,
+                          const DynamicMatrix<T>& right, ThreadPool& pool) {
+  if (left.Columns() != right.Rows()) {
+    throw std::invalid_argument("DynamicMatrix: inner dimensions differ");
+  }
+  DynamicMatrix<T> result(left.Rows(), right.Columns(),
+                          Semiring::template Zero<T>());
+  utils::Multiply<Semiring>(left, right, result, left.Rows(), left.Columns(),
+                            right.Columns(), pool);
+  return result;
+}
+
+// Same contract as StrassenMultiply for Matrix; both operands must be square
+// of the same size.
+template <typename T>
+DynamicMatrix<T> StrassenMultiply(const DynamicMatrix<T>& left,
+                                  const DynamicMatrix<T>& right,
+                                  std::size_t cutoff = utils::kStrassenCutoff) {
+  if (left.Rows() != left.Columns() || left.Rows() != right.Rows() ||
+      right.Rows() != right.Columns()) {
+    throw std::invalid_argument("DynamicMatrix: Strassen needs equal squares");
+  }
+  DynamicMatrix<T> result(left.Rows(), left.Rows());
+  utils::MultiplyStrassen(left, right, result, left.Rows(), cutoff);
+  return result;
+}
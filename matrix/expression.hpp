@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "layout.hpp"
+
+namespace utils {
+
+// Element-wise arithmetic on matrices builds a tree of these nodes instead
+// of temporaries; the tree is evaluated element by element in one loop when
+// a Matrix is constructed or assigned from it, so A + B - C * 2 makes no
+// intermediate Matrix. A node keeps a named matrix by reference and takes a
+// temporary one (the result of a product, or the Matrix that `a + 1`
+// converts 1 to) by value, as it does sub-expressions, so `auto x = a + 1;`
+// is safe for as long as a lives.
+struct ExpressionTag {};
+
+template <typename Operand>
+struct OperandTraits {
+  static const std::size_t kRows = Operand::kRows;
+  static const std::size_t kColumns = Operand::kColumns;
+  using ValueType = typename Operand::ValueType;
+  using StorageLayout = typename Operand::StorageLayout;
+};
+
+template <std::size_t N, std::size_t M, typename T, typename Layout>
+struct OperandTraits<Matrix<N, M, T, Layout>> {
+  static const std::size_t kRows = N;
+  static const std::size_t kColumns = M;
+  using ValueType = T;
+  using StorageLayout = Layout;
+};
+
+template <typename Operand>
+struct IsMatrix : std::false_type {};
+
+template <std::size_t N, std::size_t M, typename T, typename Layout>
+struct IsMatrix<Matrix<N, M, T, Layout>> : std::true_type {};
+
+template <typename Operand>
+concept MatrixExpression = std::is_base_of_v<ExpressionTag, Operand>;
+
+template <typename Operand>
+concept MatrixOperand = MatrixExpression<Operand> || IsMatrix<Operand>::value;
+
+template <typename Left, typename Right>
+concept SameShape =
+    MatrixOperand<Left> && MatrixOperand<Right> &&
+    OperandTraits<Left>::kRows == OperandTraits<Right>::kRows &&
+    OperandTraits<Left>::kColumns == OperandTraits<Right>::kColumns &&
+    std::is_same_v<typename OperandTraits<Left>::ValueType,
+                   typename OperandTraits<Right>::ValueType>;
+
+// Pairs the free operators of matrix.hpp handle: anything involving an
+// expression, and matrices of the same shape but different layouts. Two
+// matrices of one type go through Matrix's own friends.
+template <typename Left, typename Right>
+concept MixedOperands = MatrixExpression<Left> || MatrixExpression<Right> ||
+                        !std::is_same_v<Left, Right>;
+
+// The Matrix an operand evaluates to. An expression takes the layout of its
+// leftmost matrix.
+template <typename Operand>
+using EvaluatedMatrix =
+    Matrix<OperandTraits<Operand>::kRows, OperandTraits<Operand>::kColumns,
+           typename OperandTraits<Operand>::ValueType,
+           typename OperandTraits<Operand>::StorageLayout>;
+
+// What a node stores for an operand passed as Arg&&: a const reference to
+// an lvalue matrix, a copy of anything else.
+template <typename Arg>
+using StoredOperand =
+    std::conditional_t<IsMatrix<std::remove_cvref_t<Arg>>::value &&
+                           std::is_lvalue_reference_v<Arg>,
+                       const std::remove_cvref_t<Arg>&,
+                       std::remove_cvref_t<Arg>>;
+
+// Transposed() and Trace() for every node, through one evaluation.
+template <typename Derived>
+class ExpressionBase : public ExpressionTag {
+ public:
+  auto Transposed() const {
+    return EvaluatedMatrix<Derived>(static_cast<const Derived&>(*this))
+        .Transposed();
+  }
+
+  auto Trace() const {
+    return EvaluatedMatrix<Derived>(static_cast<const Derived&>(*this))
+        .Trace();
+  }
+};
+
+// left op right for every element, op being std::plus or std::minus; Left
+// and Right are StoredOperand types.
+template <typename Op, typename Left, typename Right>
+class ElementwiseExpression
+    : public ExpressionBase<ElementwiseExpression<Op, Left, Right>> {
+  using LeftTraits = OperandTraits<std::remove_cvref_t<Left>>;
+
+ public:
+  static const std::size_t kRows = LeftTraits::kRows;
+  static const std::size_t kColumns = LeftTraits::kColumns;
+  using ValueType = typename LeftTraits::ValueType;
+  using StorageLayout = typename LeftTraits::StorageLayout;
+
+  template <typename LeftArg, typename RightArg>
+  ElementwiseExpression(LeftArg&& left, RightArg&& right)
+      : left_(std::forward<LeftArg>(left)),
+        right_(std::forward<RightArg>(right)) {}
+
+  ValueType operator()(std::size_t row, std::size_t column) const {
+    return Op()(left_(row, column), right_(row, column));
+  }
+
+ private:
+  Left left_;
+  Right right_;
+};
+
+// operand * factor for every element; Operand is a StoredOperand type.
+template <typename Operand>
+class ScalingExpression : public ExpressionBase<ScalingExpression<Operand>> {
+  using Traits = OperandTraits<std::remove_cvref_t<Operand>>;
+
+ public:
+  static const std::size_t kRows = Traits::kRows;
+  static const std::size_t kColumns = Traits::kColumns;
+  using ValueType = typename Traits::ValueType;
+  using StorageLayout = typename Traits::StorageLayout;
+
+  template <typename Arg>
+  ScalingExpression(Arg&& operand, const ValueType& factor)
+      : operand_(std::forward<Arg>(operand)), factor_(factor) {}
+
+  ValueType operator()(std::size_t row, std::size_t column) const {
+    return operand_(row, column) * factor_;
+  }
+
+ private:
+  Operand operand_;
+  ValueType factor_;
+};
+
+// Node types for operands passed as Left&& and Right&&, as deduced by a
+// forwarding reference.
+template <typename Left, typename Right>
+using SumExpression = ElementwiseExpression<
+    std::plus<typename OperandTraits<std::remove_cvref_t<Left>>::ValueType>,
+    StoredOperand<Left>, StoredOperand<Right>>;
+
+template <typename Left, typename Right>
+using DifferenceExpression = ElementwiseExpression<
+    std::minus<typename OperandTraits<std::remove_cvref_t<Left>>::ValueType>,
+    StoredOperand<Left>, StoredOperand<Right>>;
+
+template <typename Operand>
+using ScaledExpression = ScalingExpression<StoredOperand<Operand>>;
+
+}  // namespace utils
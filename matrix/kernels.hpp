@@ -0,0 +1,894 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "semiring.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+namespace utils {
+
+// Products with fewer multiply-adds than this stay on the plain i-k-j loop,
+// packing does not pay for itself there.
+const std::size_t kBlockedMultiplyThreshold = 48 * 48 * 48;
+
+// Fixed-size products with at most this many multiply-adds are expanded into
+// straight-line code at compile time (MultiplyUnrolled).
+const std::size_t kUnrolledMultiplyVolume = 8 * 8 * 8;
+
+// Tile sizes in elements: a kBlockRows x kBlockDepth panel of the left
+// operand is meant to stay in L2, a kBlockDepth x kMicroColumns sliver of the
+// right one in L1.
+const std::size_t kBlockRows = 64;
+const std::size_t kBlockDepth = 256;
+const std::size_t kBlockColumns = 512;
+const std::size_t kMicroRows = 4;
+// one 64-byte vector per micro-tile row for float, double and int64_t
+template <typename T>
+const std::size_t kMicroColumns = 8;
+template <>
+const std::size_t kMicroColumns<float> = 16;
+
+// Square tile handled by one in-register transpose (one 32-byte vector per
+// row), 0 if T has none. Without MATRIX_SIMD the scalar TransposeTile moves
+// the same tiles.
+template <typename T>
+const std::size_t kTransposeTile = 0;
+template <>
+const std::size_t kTransposeTile<float> = 32 / sizeof(float);
+template <>
+const std::size_t kTransposeTile<double> = 32 / sizeof(double);
+template <>
+const std::size_t kTransposeTile<int64_t> = 32 / sizeof(int64_t);
+
+const std::size_t kCacheLine = 64;
+
+// Hands out cache-line aligned blocks, so vector loads of a buffer start on
+// a line boundary.
+template <typename T, std::size_t Alignment = kCacheLine>
+struct AlignedAllocator {
+  using value_type = T;
+  template <typename U>
+  struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>& /*other*/) {}
+
+  T* allocate(std::size_t count) {
+    return static_cast<T*>(
+        ::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+  }
+  void deallocate(T* ptr, std::size_t /*count*/) {
+    ::operator delete(ptr, std::align_val_t(Alignment));
+  }
+
+  bool operator==(const AlignedAllocator& other) const = default;
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+template <typename Matrix>
+using ElementType =
+    std::remove_cvref_t<decltype(std::declval<const Matrix&>()(0, 0))>;
+
+// Row-major block of a larger buffer, addressed like a matrix.
+template <typename T>
+struct StridedBlock {
+  T& operator()(std::size_t row, std::size_t column) const {
+    return data[row * stride + column];
+  }
+
+  // the block whose top-left element is (row, column)
+  StridedBlock Offset(std::size_t row, std::size_t column) const {
+    return {data + row * stride + column, stride};
+  }
+
+  StridedBlock Quadrant(std::size_t row, std::size_t column,
+                        std::size_t half) const {
+    return Offset(row * half, column * half);
+  }
+
+  T* data;
+  std::size_t stride;
+};
+
+// Copies left[row_begin.., depth_begin..] into micro-panels of kMicroRows
+// rows stored column after column, padding the last panel with T().
+template <typename Left, typename T>
+void PackLeft(const Left& left, std::size_t row_begin, std::size_t rows,
+              std::size_t depth_begin, std::size_t depth, T* packed) {
+  for (std::size_t panel = 0; panel < rows; panel += kMicroRows) {
+    std::size_t height = std::min(kMicroRows, rows - panel);
+    for (std::size_t k = 0; k < depth; ++k) {
+      for (std::size_t i = 0; i < kMicroRows; ++i) {
+        *packed++ = (i < height ? left(row_begin + panel + i, depth_begin + k)
+                                : T());
+      }
+    }
+  }
+}
+
+// Copies right[depth_begin.., column_begin..] into micro-panels of
+// kMicroColumns columns stored row after row, padding the last panel with T().
+template <typename Right, typename T>
+void PackRight(const Right& right, std::size_t depth_begin, std::size_t depth,
+               std::size_t column_begin, std::size_t columns, T* packed) {
+  for (std::size_t panel = 0; panel < columns; panel += kMicroColumns<T>) {
+    std::size_t width = std::min(kMicroColumns<T>, columns - panel);
+    for (std::size_t k = 0; k < depth; ++k) {
+      for (std::size_t j = 0; j < kMicroColumns<T>; ++j) {
+        *packed++ =
+            (j < width ? right(depth_begin + k, column_begin + panel + j)
+                       : T());
+      }
+    }
+  }
+}
+
+// Accumulates a kMicroRows x kMicroColumns tile of the product of two packed
+// micro-panels in local accumulators, so the hot loop never touches memory
+// other than the two contiguous panels. The products and sums are those of
+// Semiring; acc must start out at Semiring::Zero<T>().
+template <typename Semiring, typename T>
+void MicroKernel(const T* left, const T* right, std::size_t depth,
+                 T (&acc)[kMicroRows][kMicroColumns<T>]) {
+  for (std::size_t k = 0; k < depth; ++k) {
+    for (std::size_t i = 0; i < kMicroRows; ++i) {
+      for (std::size_t j = 0; j < kMicroColumns<T>; ++j) {
+        Semiring::MultiplyAdd(acc[i][j], left[i], right[j]);
+      }
+    }
+    left += kMicroRows;
+    right += kMicroColumns<T>;
+  }
+}
+
+#ifdef MATRIX_SIMD
+// Floating-point tropical products saturate through infinity by themselves,
+// so every semiring runs on the SIMD kernel for float and double; int64_t
+// only does for ordinary arithmetic, tropical sums of integers saturate by
+// hand and stay on the scalar kernel.
+template <typename Semiring>
+void MicroKernel(const float* left, const float* right, std::size_t depth,
+                 float (&acc)[kMicroRows][kMicroColumns<float>]) {
+  simd::MicroKernel<Semiring, float, kMicroRows, kMicroColumns<float>>(
+      left, right, depth, acc[0]);
+}
+
+template <typename Semiring>
+void MicroKernel(const double* left, const double* right, std::size_t depth,
+                 double (&acc)[kMicroRows][kMicroColumns<double>]) {
+  simd::MicroKernel<Semiring, double, kMicroRows, kMicroColumns<double>>(
+      left, right, depth, acc[0]);
+}
+
+template <typename Semiring>
+  requires std::is_same_v<Semiring, PlusTimes>
+void MicroKernel(const int64_t* left, const int64_t* right,
+                 std::size_t depth,
+                 int64_t (&acc)[kMicroRows][kMicroColumns<int64_t>]) {
+  simd::MicroKernel<Semiring, int64_t, kMicroRows, kMicroColumns<int64_t>>(
+      left, right, depth, acc[0]);
+}
+#endif
+
+template <typename T>
+void AddTo(T* dst, const T* src, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    dst[i] += src[i];
+  }
+}
+
+#ifdef MATRIX_SIMD
+inline void AddTo(float* dst, const float* src, std::size_t count) {
+  simd::Add(dst, src, count);
+}
+inline void AddTo(double* dst, const double* src, std::size_t count) {
+  simd::Add(dst, src, count);
+}
+inline void AddTo(int64_t* dst, const int64_t* src, std::size_t count) {
+  simd::Add(dst, src, count);
+}
+#endif
+
+template <typename T>
+void SubtractFrom(T* dst, const T* src, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    dst[i] -= src[i];
+  }
+}
+
+#ifdef MATRIX_SIMD
+inline void SubtractFrom(float* dst, const float* src, std::size_t count) {
+  simd::Subtract(dst, src, count);
+}
+inline void SubtractFrom(double* dst, const double* src, std::size_t count) {
+  simd::Subtract(dst, src, count);
+}
+inline void SubtractFrom(int64_t* dst, const int64_t* src,
+                         std::size_t count) {
+  simd::Subtract(dst, src, count);
+}
+#endif
+
+template <typename T>
+void ScaleBy(T* dst, const T& factor, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    dst[i] *= factor;
+  }
+}
+
+#ifdef MATRIX_SIMD
+inline void ScaleBy(float* dst, float factor, std::size_t count) {
+  simd::Scale(dst, factor, count);
+}
+inline void ScaleBy(double* dst, double factor, std::size_t count) {
+  simd::Scale(dst, factor, count);
+}
+inline void ScaleBy(int64_t* dst, int64_t factor, std::size_t count) {
+  simd::Scale(dst, factor, count);
+}
+#endif
+
+// Lanes [begin, end) of a batched product stored element-major: the lanes
+// of element e of every left matrix start at left + e * stride, elements
+// numbered row by row, likewise right and result. Each step is one vector
+// operation across matrices, so small sizes still fill whole registers.
+template <std::size_t Rows, std::size_t Inner, std::size_t Columns,
+          typename T>
+void MultiplyBatch(const T* left, const T* right, T* result,
+                   std::size_t stride, std::size_t begin, std::size_t end) {
+  for (std::size_t lane = begin; lane < end; ++lane) {
+    for (std::size_t i = 0; i < Rows; ++i) {
+      for (std::size_t j = 0; j < Columns; ++j) {
+        T sum = T();
+        for (std::size_t k = 0; k < Inner; ++k) {
+          sum += left[(i * Inner + k) * stride + lane] *
+                 right[(k * Columns + j) * stride + lane];
+        }
+        result[(i * Columns + j) * stride + lane] = sum;
+      }
+    }
+  }
+}
+
+#ifdef MATRIX_SIMD
+template <std::size_t Rows, std::size_t Inner, std::size_t Columns>
+void MultiplyBatch(const float* left, const float* right, float* result,
+                   std::size_t stride, std::size_t begin, std::size_t end) {
+  simd::MultiplyBatch<float, Rows, Inner, Columns>(left, right, result,
+                                                   stride, begin, end);
+}
+template <std::size_t Rows, std::size_t Inner, std::size_t Columns>
+void MultiplyBatch(const double* left, const double* right, double* result,
+                   std::size_t stride, std::size_t begin, std::size_t end) {
+  simd::MultiplyBatch<double, Rows, Inner, Columns>(left, right, result,
+                                                    stride, begin, end);
+}
+template <std::size_t Rows, std::size_t Inner, std::size_t Columns>
+void MultiplyBatch(const int64_t* left, const int64_t* right,
+                   int64_t* result, std::size_t stride, std::size_t begin,
+                   std::size_t end) {
+  simd::MultiplyBatch<int64_t, Rows, Inner, Columns>(left, right, result,
+                                                     stride, begin, end);
+}
+#endif
+
+template <typename T>
+void TransposeTile(const T* const* src, T* const* dst) {
+  for (std::size_t i = 0; i < kTransposeTile<T>; ++i) {
+    for (std::size_t j = 0; j < kTransposeTile<T>; ++j) {
+      dst[j][i] = src[i][j];
+    }
+  }
+}
+
+#ifdef MATRIX_SIMD
+inline void TransposeTile(const float* const* src, float* const* dst) {
+  simd::TransposeTile(src, dst);
+}
+inline void TransposeTile(const double* const* src, double* const* dst) {
+  simd::TransposeTile(src, dst);
+}
+inline void TransposeTile(const int64_t* const* src, int64_t* const* dst) {
+  simd::TransposeTile(src, dst);
+}
+#endif
+
+// Transposes of blocks at most this many elements on a side run directly,
+// larger ones are halved along their longer side first. The recursion keeps
+// the rows read and the rows written in cache at every level without
+// knowing the cache size; block edges stay multiples of the leaf size, so
+// in-register tiles never straddle two leaves. Leaves are sized for L2
+// rather than L1: a leaf sweeps its tiles row by row, which keeps the
+// hardware prefetchers streaming, and 32-element leaves measured up to 1.7x
+// slower than this on sizes that are not a power of two.
+const std::size_t kTransposeBlock = 128;
+
+inline std::size_t TransposeSplit(std::size_t length) {
+  return std::max(kTransposeBlock,
+                  length / 2 / kTransposeBlock * kTransposeBlock);
+}
+
+// Leaf of Transpose: in-register tiles where they fit, scalar copies for
+// the ragged edge of the matrix.
+template <typename SrcRow, typename DstRow>
+void TransposeLeaf(SrcRow src_row, DstRow dst_row, std::size_t row_begin,
+                   std::size_t row_end, std::size_t column_begin,
+                   std::size_t column_end) {
+  using T = std::remove_pointer_t<decltype(dst_row(0))>;
+  const std::size_t kTile = kTransposeTile<T>;
+  std::size_t tiled_rows = row_begin;
+  std::size_t tiled_columns = column_begin;
+  if (kTile != 0) {
+    tiled_rows = row_end - (row_end - row_begin) % kTile;
+    tiled_columns = column_end - (column_end - column_begin) % kTile;
+    const T* src[kTransposeTile<float>];
+    T* dst[kTransposeTile<float>];
+    for (std::size_t i = row_begin; i < tiled_rows; i += kTile) {
+      for (std::size_t j = column_begin; j < tiled_columns; j += kTile) {
+        for (std::size_t k = 0; k < kTile; ++k) {
+          src[k] = src_row(i + k) + j;
+          dst[k] = dst_row(j + k) + i;
+        }
+        TransposeTile(src, dst);
+      }
+    }
+  }
+  for (std::size_t i = row_begin; i < row_end; ++i) {
+    for (std::size_t j = (i < tiled_rows ? tiled_columns : column_begin);
+         j < column_end; ++j) {
+      dst_row(j)[i] = src_row(i)[j];
+    }
+  }
+}
+
+template <typename SrcRow, typename DstRow>
+void TransposeRecursive(SrcRow src_row, DstRow dst_row, std::size_t row_begin,
+                        std::size_t row_end, std::size_t column_begin,
+                        std::size_t column_end) {
+  std::size_t rows = row_end - row_begin;
+  std::size_t columns = column_end - column_begin;
+  if (rows <= kTransposeBlock && columns <= kTransposeBlock) {
+    TransposeLeaf(src_row, dst_row, row_begin, row_end, column_begin,
+                  column_end);
+  } else if (rows >= columns) {
+    std::size_t middle = row_begin + TransposeSplit(rows);
+    TransposeRecursive(src_row, dst_row, row_begin, middle, column_begin,
+                       column_end);
+    TransposeRecursive(src_row, dst_row, middle, row_end, column_begin,
+                       column_end);
+  } else {
+    std::size_t middle = column_begin + TransposeSplit(columns);
+    TransposeRecursive(src_row, dst_row, row_begin, row_end, column_begin,
+                       middle);
+    TransposeRecursive(src_row, dst_row, row_begin, row_end, middle,
+                       column_end);
+  }
+}
+
+// dst_row(j)[i] = src_row(i)[j] for a rows x columns source, where src_row
+// and dst_row return pointers to contiguous rows.
+template <typename SrcRow, typename DstRow>
+void Transpose(SrcRow src_row, DstRow dst_row, std::size_t rows,
+               std::size_t columns) {
+  TransposeRecursive(src_row, dst_row, 0, rows, 0, columns);
+}
+
+// Exchanges the tile at (i, j) with the transpose of the tile at (j, i),
+// going through a scratch tile; i == j transposes a diagonal tile in place.
+template <typename Row>
+void SwapTransposedTiles(Row row, std::size_t i, std::size_t j) {
+  using T = std::remove_pointer_t<decltype(row(0))>;
+  const std::size_t kTile = kTransposeTile<T>;
+  T scratch[kTransposeTile<float> * kTransposeTile<float>];
+  const T* src[kTransposeTile<float>];
+  T* dst[kTransposeTile<float>];
+  for (std::size_t k = 0; k < kTile; ++k) {
+    src[k] = row(i + k) + j;
+    dst[k] = scratch + k * kTile;
+  }
+  TransposeTile(src, dst);
+  if (i != j) {
+    for (std::size_t k = 0; k < kTile; ++k) {
+      src[k] = row(j + k) + i;
+      dst[k] = row(i + k) + j;
+    }
+    TransposeTile(src, dst);
+  }
+  for (std::size_t k = 0; k < kTile; ++k) {
+    std::copy(scratch + k * kTile, scratch + (k + 1) * kTile, row(j + k) + i);
+  }
+}
+
+// Swaps the block [row_begin, row_end) x [column_begin, column_end) with
+// the transpose of its mirror image; diagonal marks a block that is its own
+// mirror, where only the part above the diagonal is visited.
+template <typename Row>
+void SwapTransposedLeaf(Row row, std::size_t row_begin, std::size_t row_end,
+                        std::size_t column_begin, std::size_t column_end,
+                        bool diagonal) {
+  using T = std::remove_pointer_t<decltype(row(0))>;
+  const std::size_t kTile = kTransposeTile<T>;
+  std::size_t tiled_rows = row_begin;
+  std::size_t tiled_columns = column_begin;
+  if (kTile != 0) {
+    tiled_rows = row_end - (row_end - row_begin) % kTile;
+    tiled_columns = column_end - (column_end - column_begin) % kTile;
+    for (std::size_t i = row_begin; i < tiled_rows; i += kTile) {
+      for (std::size_t j = (diagonal ? i : column_begin); j < tiled_columns;
+           j += kTile) {
+        SwapTransposedTiles(row, i, j);
+      }
+    }
+  }
+  for (std::size_t i = row_begin; i < row_end; ++i) {
+    std::size_t j = (i < tiled_rows ? tiled_columns : column_begin);
+    if (diagonal) {
+      j = std::max(j, i + 1);
+    }
+    for (; j < column_end; ++j) {
+      std::swap(row(i)[j], row(j)[i]);
+    }
+  }
+}
+
+template <typename Row>
+void SwapTransposedRecursive(Row row, std::size_t row_begin,
+                             std::size_t row_end, std::size_t column_begin,
+                             std::size_t column_end) {
+  std::size_t rows = row_end - row_begin;
+  std::size_t columns = column_end - column_begin;
+  if (rows <= kTransposeBlock && columns <= kTransposeBlock) {
+    SwapTransposedLeaf(row, row_begin, row_end, column_begin, column_end,
+                       false);
+  } else if (rows >= columns) {
+    std::size_t middle = row_begin + TransposeSplit(rows);
+    SwapTransposedRecursive(row, row_begin, middle, column_begin, column_end);
+    SwapTransposedRecursive(row, middle, row_end, column_begin, column_end);
+  } else {
+    std::size_t middle = column_begin + TransposeSplit(columns);
+    SwapTransposedRecursive(row, row_begin, row_end, column_begin, middle);
+    SwapTransposedRecursive(row, row_begin, row_end, middle, column_end);
+  }
+}
+
+// Transposes the square block [begin, end) x [begin, end) in place: the two
+// diagonal halves recurse, the off-diagonal halves trade places.
+template <typename Row>
+void TransposeInPlaceRecursive(Row row, std::size_t begin, std::size_t end) {
+  if (end - begin <= kTransposeBlock) {
+    SwapTransposedLeaf(row, begin, end, begin, end, true);
+    return;
+  }
+  std::size_t middle = begin + TransposeSplit(end - begin);
+  TransposeInPlaceRecursive(row, begin, middle);
+  TransposeInPlaceRecursive(row, middle, end);
+  SwapTransposedRecursive(row, begin, middle, middle, end);
+}
+
+// row(i)[j] <-> row(j)[i] for a size x size matrix of contiguous rows.
+template <typename Row>
+void TransposeInPlace(Row row, std::size_t size) {
+  TransposeInPlaceRecursive(row, 0, size);
+}
+
+template <typename Semiring = PlusTimes, typename Left, typename Right,
+          typename Result>
+void MultiplyNaive(const Left& left, const Right& right, Result& result,
+                   std::size_t rows, std::size_t inner, std::size_t columns) {
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t k = 0; k < inner; ++k) {
+      const auto& elem = left(i, k);
+      for (std::size_t j = 0; j < columns; ++j) {
+        Semiring::MultiplyAdd(result(i, j), elem, right(k, j));
+      }
+    }
+  }
+}
+
+// Packing space of MultiplyBlock for one thread: grows to the largest block
+// seen and is reused by later calls. Elements are default-initialized only
+// when it grows, which is nothing for arithmetic T, since packing writes
+// every element before the micro-kernel reads it.
+template <typename T>
+class PackingBuffer {
+ public:
+  PackingBuffer() = default;
+  PackingBuffer(const PackingBuffer& other) = delete;
+  PackingBuffer& operator=(const PackingBuffer& other) = delete;
+  ~PackingBuffer() { Release(); }
+
+  T* Get(std::size_t size) {
+    if (size > size_) {
+      Release();
+      T* data = AlignedAllocator<T>().allocate(size);
+      try {
+        std::uninitialized_default_construct_n(data, size);
+      } catch (...) {
+        AlignedAllocator<T>().deallocate(data, size);
+        throw;
+      }
+      data_ = data;
+      size_ = size;
+    }
+    return data_;
+  }
+
+ private:
+  void Release() {
+    if (data_ != nullptr) {
+      std::destroy_n(data_, size_);
+      AlignedAllocator<T>().deallocate(data_, size_);
+      data_ = nullptr;
+      size_ = 0;
+    }
+  }
+
+  T* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+template <typename T>
+struct PackingBuffers {
+  PackingBuffer<T> left;
+  PackingBuffer<T> right;
+};
+
+// One pair per thread and element type, shared by every instantiation of
+// MultiplyBlock for that type.
+template <typename T>
+PackingBuffers<T>& ThreadPackingBuffers() {
+  thread_local PackingBuffers<T> buffers;
+  return buffers;
+}
+
+// result += left * right over the output block [row_begin, row_begin + rows)
+// x [column_begin, column_begin + columns), for any row/column accessors:
+// both operands are packed tile by tile (i-k-j over tiles), so the layout of
+// the sources only matters during the O(n^2) packing. Sums and products are
+// those of Semiring.
+template <typename Semiring = PlusTimes, typename Left, typename Right,
+          typename Result>
+void MultiplyBlock(const Left& left, const Right& right, Result& result,
+                   std::size_t row_begin, std::size_t rows,
+                   std::size_t column_begin, std::size_t columns,
+                   std::size_t inner) {
+  using T = ElementType<Result>;
+  std::size_t max_height =
+      (std::min(kBlockRows, rows) + kMicroRows - 1) / kMicroRows * kMicroRows;
+  std::size_t max_width = (std::min(kBlockColumns, columns) +
+                           kMicroColumns<T> - 1) /
+                          kMicroColumns<T> * kMicroColumns<T>;
+  std::size_t max_depth = std::min(kBlockDepth, inner);
+  PackingBuffers<T>& buffers = ThreadPackingBuffers<T>();
+  T* packed_left = buffers.left.Get(max_height * max_depth);
+  T* packed_right = buffers.right.Get(max_depth * max_width);
+
+  for (std::size_t jj = 0; jj < columns; jj += kBlockColumns) {
+    std::size_t width = std::min(kBlockColumns, columns - jj);
+    for (std::size_t kk = 0; kk < inner; kk += kBlockDepth) {
+      std::size_t depth = std::min(kBlockDepth, inner - kk);
+      PackRight(right, kk, depth, column_begin + jj, width, packed_right);
+      for (std::size_t ii = 0; ii < rows; ii += kBlockRows) {
+        std::size_t height = std::min(kBlockRows, rows - ii);
+        PackLeft(left, row_begin + ii, height, kk, depth, packed_left);
+
+        for (std::size_t j = 0; j < width; j += kMicroColumns<T>) {
+          for (std::size_t i = 0; i < height; i += kMicroRows) {
+            T acc[kMicroRows][kMicroColumns<T>];
+            std::fill(&acc[0][0], &acc[0][0] + kMicroRows * kMicroColumns<T>,
+                      Semiring::template Zero<T>());
+            MicroKernel<Semiring>(packed_left + i * depth,
+                                  packed_right + j * depth, depth, acc);
+            std::size_t tile_rows = std::min(kMicroRows, height - i);
+            std::size_t tile_columns = std::min(kMicroColumns<T>, width - j);
+            for (std::size_t r = 0; r < tile_rows; ++r) {
+              for (std::size_t c = 0; c < tile_columns; ++c) {
+                Semiring::Add(
+                    result(row_begin + ii + i + r, column_begin + jj + j + c),
+                    acc[r][c]);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Semiring = PlusTimes, typename Left, typename Right,
+          typename Result>
+void MultiplyBlocked(const Left& left, const Right& right, Result& result,
+                     std::size_t rows, std::size_t inner,
+                     std::size_t columns) {
+  MultiplyBlock<Semiring>(left, right, result, 0, rows, 0, columns, inner);
+}
+
+// Boolean products work on rows packed kWordBits elements to a word: bit
+// j % kWordBits of word j / kWordBits stands for element j != T().
+const std::size_t kWordBits = 64;
+
+inline std::size_t PackedWords(std::size_t bits) {
+  return (bits + kWordBits - 1) / kWordBits;
+}
+
+template <typename Source>
+void PackBits(const Source& source, std::size_t rows, std::size_t columns,
+              uint64_t* packed) {
+  using T = ElementType<Source>;
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t w = 0; w < PackedWords(columns); ++w) {
+      std::size_t width = std::min(kWordBits, columns - w * kWordBits);
+      uint64_t word = 0;
+      for (std::size_t b = 0; b < width; ++b) {
+        if (source(i, w * kWordBits + b) != T()) {
+          word |= uint64_t(1) << b;
+        }
+      }
+      *packed++ = word;
+    }
+  }
+}
+
+template <typename Result>
+void UnpackBits(const uint64_t* packed, std::size_t rows, std::size_t columns,
+                Result& result) {
+  using T = ElementType<Result>;
+  for (std::size_t i = 0; i < rows; ++i) {
+    const uint64_t* row = packed + i * PackedWords(columns);
+    for (std::size_t j = 0; j < columns; ++j) {
+      result(i, j) = ((row[j / kWordBits] >> (j % kWordBits)) & 1) != 0
+                         ? static_cast<T>(1)
+                         : T();
+    }
+  }
+}
+
+// Rows [row_begin, row_end) of result |= left * right over packed rows: the
+// packed row k of right is ORed into result row i for every set bit k of
+// left row i, kWordBits columns per instruction, and set bits are found a
+// word at a time with countr_zero, so sparse rows cost only their bits.
+// Depth and column tiles keep the right rows in use in L1 while every
+// result row sweeps over them.
+inline void MultiplyPackedRows(const uint64_t* left, const uint64_t* right,
+                               uint64_t* result, std::size_t row_begin,
+                               std::size_t row_end, std::size_t inner,
+                               std::size_t columns) {
+  const std::size_t kTileWords = kBlockColumns / kWordBits;
+  const std::size_t kDepthWords = kBlockDepth / kWordBits;
+  std::size_t inner_words = PackedWords(inner);
+  std::size_t words = PackedWords(columns);
+  for (std::size_t jj = 0; jj < words; jj += kTileWords) {
+    std::size_t width = std::min(kTileWords, words - jj);
+    for (std::size_t kk = 0; kk < inner_words; kk += kDepthWords) {
+      std::size_t depth_end = std::min(kk + kDepthWords, inner_words);
+      for (std::size_t i = row_begin; i < row_end; ++i) {
+        uint64_t* dst = result + i * words + jj;
+        for (std::size_t kw = kk; kw < depth_end; ++kw) {
+          for (uint64_t bits = left[i * inner_words + kw]; bits != 0;
+               bits &= bits - 1) {
+            std::size_t k = kw * kWordBits + std::countr_zero(bits);
+            const uint64_t* src = right + k * words + jj;
+            for (std::size_t w = 0; w < width; ++w) {
+              dst[w] |= src[w];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Operands of a boolean product packed into bit rows, with result packed
+// as well so that the product is ORed into what it already holds.
+struct PackedProduct {
+  template <typename Left, typename Right, typename Result>
+  PackedProduct(const Left& left, const Right& right, const Result& result,
+                std::size_t rows, std::size_t inner, std::size_t columns)
+      : left_bits(rows * PackedWords(inner)),
+        right_bits(inner * PackedWords(columns)),
+        result_bits(rows * PackedWords(columns)) {
+    PackBits(left, rows, inner, left_bits.data());
+    PackBits(right, inner, columns, right_bits.data());
+    PackBits(result, rows, columns, result_bits.data());
+  }
+
+  AlignedVector<uint64_t> left_bits;
+  AlignedVector<uint64_t> right_bits;
+  AlignedVector<uint64_t> result_bits;
+};
+
+template <typename Semiring = PlusTimes, typename Left, typename Right,
+          typename Result>
+  requires(!std::is_same_v<Semiring, OrAnd>)
+void Multiply(const Left& left, const Right& right, Result& result,
+              std::size_t rows, std::size_t inner, std::size_t columns) {
+  if (rows * inner * columns < kBlockedMultiplyThreshold) {
+    MultiplyNaive<Semiring>(left, right, result, rows, inner, columns);
+  } else {
+    MultiplyBlocked<Semiring>(left, right, result, rows, inner, columns);
+  }
+}
+
+template <typename Semiring, typename Left, typename Right, typename Result>
+  requires std::is_same_v<Semiring, OrAnd>
+void Multiply(const Left& left, const Right& right, Result& result,
+              std::size_t rows, std::size_t inner, std::size_t columns) {
+  PackedProduct packed(left, right, result, rows, inner, columns);
+  MultiplyPackedRows(packed.left_bits.data(), packed.right_bits.data(),
+                     packed.result_bits.data(), 0, rows, inner, columns);
+  UnpackBits(packed.result_bits.data(), rows, columns, result);
+}
+
+// result = left * right for a result whose elements may be uninitialized.
+// Small products start every row from its first term instead of from zero;
+// big ones clear the result once and accumulate into it as usual.
+template <typename Left, typename Right, typename Result>
+void MultiplyOverwrite(const Left& left, const Right& right, Result& result,
+                       std::size_t rows, std::size_t inner,
+                       std::size_t columns) {
+  using T = ElementType<Result>;
+  if (inner == 0 || rows * inner * columns >= kBlockedMultiplyThreshold) {
+    for (std::size_t i = 0; i < rows; ++i) {
+      for (std::size_t j = 0; j < columns; ++j) {
+        result(i, j) = T();
+      }
+    }
+    MultiplyBlocked(left, right, result, rows, inner, columns);
+    return;
+  }
+  for (std::size_t i = 0; i < rows; ++i) {
+    const auto& first = left(i, 0);
+    for (std::size_t j = 0; j < columns; ++j) {
+      result(i, j) = first * right(0, j);
+    }
+    for (std::size_t k = 1; k < inner; ++k) {
+      const auto& elem = left(i, k);
+      for (std::size_t j = 0; j < columns; ++j) {
+        result(i, j) += elem * right(k, j);
+      }
+    }
+  }
+}
+
+// Row of left times column of right, spelled out term by term.
+template <std::size_t Row, std::size_t Column, typename Left, typename Right,
+          std::size_t... Depth>
+auto DotUnrolled(const Left& left, const Right& right,
+                 std::index_sequence<Depth...> /*depth*/) {
+  return (... + (left(Row, Depth) * right(Depth, Column)));
+}
+
+template <std::size_t Inner, std::size_t Columns, typename Left,
+          typename Right, typename Result, std::size_t... Elements>
+void MultiplyUnrolled(const Left& left, const Right& right, Result& result,
+                      std::index_sequence<Elements...> /*elements*/) {
+  ((result(Elements / Columns, Elements % Columns) =
+        DotUnrolled<Elements / Columns, Elements % Columns>(
+            left, right, std::make_index_sequence<Inner>())),
+   ...);
+}
+
+// result = left * right for Rows x Inner times Inner x Columns operands, as
+// one straight-line expression per element with no loops or size checks
+// left, so small products such as 4 x 4 cost only their multiply-adds.
+// result may be uninitialized and must not alias either operand.
+template <std::size_t Rows, std::size_t Inner, std::size_t Columns,
+          typename Left, typename Right, typename Result>
+void MultiplyUnrolled(const Left& left, const Right& right, Result& result) {
+  MultiplyUnrolled<Inner, Columns>(left, right, result,
+                                   std::make_index_sequence<Rows * Columns>());
+}
+
+// result = left * right mod modulus for operands already reduced into
+// [0, modulus). Products are summed in 128 bits and reduced only when the
+// next batch of them could overflow the sum, which for moduli below 2^32
+// means once per element. acc is scratch space, kept by the caller so that
+// repeated products do not allocate.
+template <typename Left, typename Right, typename Result>
+void MultiplyModular(const Left& left, const Right& right, Result& result,
+                     std::size_t rows, std::size_t inner, std::size_t columns,
+                     uint64_t modulus, std::vector<unsigned __int128>& acc) {
+  using Wide = unsigned __int128;
+  Wide largest = Wide(modulus - 1) * (modulus - 1);
+  Wide batch = (largest == 0 ? Wide(inner) : (~Wide(0) - modulus) / largest);
+  acc.resize(columns);
+  for (std::size_t i = 0; i < rows; ++i) {
+    std::fill(acc.begin(), acc.end(), Wide(0));
+    Wide pending = 0;
+    for (std::size_t k = 0; k < inner; ++k) {
+      uint64_t elem = left(i, k);
+      if (elem == 0) {
+        continue;
+      }
+      if (pending == batch) {
+        for (auto& sum : acc) {
+          sum %= modulus;
+        }
+        pending = 0;
+      }
+      for (std::size_t j = 0; j < columns; ++j) {
+        acc[j] += Wide(elem) * static_cast<uint64_t>(right(k, j));
+      }
+      ++pending;
+    }
+    for (std::size_t j = 0; j < columns; ++j) {
+      result(i, j) = static_cast<uint64_t>(acc[j] % modulus);
+    }
+  }
+}
+
+// Output tiles handed to the pool as separate tasks: small enough to give
+// every thread several of them, large enough to amortize packing.
+const std::size_t kParallelTileRows = kBlockRows;
+const std::size_t kParallelTileColumns = 256;
+
+// Same as Multiply, with the output split into independent tiles that run
+// on the pool. Every task writes a disjoint block of result.
+template <typename Semiring = PlusTimes, typename Left, typename Right,
+          typename Result>
+  requires(!std::is_same_v<Semiring, OrAnd>)
+void Multiply(const Left& left, const Right& right, Result& result,
+              std::size_t rows, std::size_t inner, std::size_t columns,
+              ThreadPool& pool) {
+  if (pool.Size() == 1 ||
+      rows * inner * columns < kBlockedMultiplyThreshold) {
+    Multiply<Semiring>(left, right, result, rows, inner, columns);
+    return;
+  }
+  std::vector<std::function<void()>> tasks;
+  for (std::size_t i = 0; i < rows; i += kParallelTileRows) {
+    for (std::size_t j = 0; j < columns; j += kParallelTileColumns) {
+      tasks.emplace_back([&left, &right, &result, i, j, rows, columns, inner] {
+        MultiplyBlock<Semiring>(left, right, result, i,
+                                std::min(kParallelTileRows, rows - i), j,
+                                std::min(kParallelTileColumns, columns - j),
+                                inner);
+      });
+    }
+  }
+  pool.Run(std::move(tasks));
+}
+
+// Boolean products split by rows only: a packed result row is a handful of
+// words, and every task reads all of right anyway. One word operation does
+// kWordBits multiply-adds, hence the higher threshold.
+template <typename Semiring, typename Left, typename Right, typename Result>
+  requires std::is_same_v<Semiring, OrAnd>
+void Multiply(const Left& left, const Right& right, Result& result,
+              std::size_t rows, std::size_t inner, std::size_t columns,
+              ThreadPool& pool) {
+  if (pool.Size() == 1 ||
+      rows * inner * columns < kBlockedMultiplyThreshold * kWordBits) {
+    Multiply<Semiring>(left, right, result, rows, inner, columns);
+    return;
+  }
+  PackedProduct packed(left, right, result, rows, inner, columns);
+  std::vector<std::function<void()>> tasks;
+  for (std::size_t i = 0; i < rows; i += kParallelTileRows) {
+    tasks.emplace_back([&packed, i, rows, inner, columns] {
+      MultiplyPackedRows(packed.left_bits.data(), packed.right_bits.data(),
+                         packed.result_bits.data(), i,
+                         std::min(i + kParallelTileRows, rows), inner,
+                         columns);
+    });
+  }
+  pool.Run(std::move(tasks));
+  UnpackBits(packed.result_bits.data(), rows, columns, result);
+}
+
+}  // namespace utils
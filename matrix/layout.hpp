@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Storage orders for Matrix. Layout::Storage<N, M, T> says how many
+// elements the buffer of an N x M matrix of T holds (kSize), how it is
+// aligned (kAlignment) and where element (i, j) of it lives (Index). Layouts
+// that keep every row or every column contiguous also give the distance
+// between neighbours in either direction, so strided views and line-by-line
+// kernels can use them.
+struct RowMajor {
+  template <std::size_t N, std::size_t M, typename T>
+  struct Storage {
+    static const std::size_t kSize = N * M;
+    static const std::size_t kAlignment = alignof(T);
+    static const std::size_t kRowStride = M;
+    static const std::size_t kColumnStride = 1;
+
+    static std::size_t Index(std::size_t row, std::size_t column) {
+      return row * M + column;
+    }
+  };
+};
+
+struct ColumnMajor {
+  template <std::size_t N, std::size_t M, typename T>
+  struct Storage {
+    static const std::size_t kSize = N * M;
+    static const std::size_t kAlignment = alignof(T);
+    static const std::size_t kRowStride = 1;
+    static const std::size_t kColumnStride = N;
+
+    static std::size_t Index(std::size_t row, std::size_t column) {
+      return column * N + row;
+    }
+  };
+};
+
+// Tile x Tile blocks stored one after another in row-major order of blocks,
+// each block row-major inside; a block is one contiguous chunk, so whole
+// blocks stay in cache together whichever direction they are walked in. The
+// last block row and column are padded up to full blocks with T().
+template <std::size_t Tile = 8>
+struct Tiled {
+  template <std::size_t N, std::size_t M, typename T>
+  struct Storage {
+    static const std::size_t kAlignment = alignof(T);
+    static const std::size_t kTile = Tile;
+    static const std::size_t kTileRows = (N + Tile - 1) / Tile;
+    static const std::size_t kTileColumns = (M + Tile - 1) / Tile;
+    static const std::size_t kSize = kTileRows * kTileColumns * Tile * Tile;
+
+    static std::size_t Index(std::size_t row, std::size_t column) {
+      return ((row / Tile) * kTileColumns + column / Tile) * Tile * Tile +
+             (row % Tile) * Tile + column % Tile;
+    }
+  };
+};
+
+// Row-major with every row starting on an Alignment-byte boundary: the
+// buffer is aligned and each row is padded with T() up to a whole number of
+// Alignment-byte chunks. Vector loads along a row then never straddle two
+// cache lines, and the same row kernels handle every row with no peeled
+// head. Costs up to Alignment - sizeof(T) bytes per row.
+template <std::size_t Alignment = 64>
+struct AlignedRows {
+  template <std::size_t N, std::size_t M, typename T>
+  struct Storage {
+    static const std::size_t kLanes =
+        Alignment > sizeof(T) ? Alignment / sizeof(T) : 1;
+    static const std::size_t kRowStride = (M + kLanes - 1) / kLanes * kLanes;
+    static const std::size_t kColumnStride = 1;
+    static const std::size_t kSize = N * kRowStride;
+    static const std::size_t kAlignment =
+        Alignment > alignof(T) ? Alignment : alignof(T);
+
+    static std::size_t Index(std::size_t row, std::size_t column) {
+      return row * kRowStride + column;
+    }
+  };
+};
+
+template <std::size_t N, std::size_t M, typename T = int64_t,
+          typename Layout = RowMajor>
+class Matrix;
+
+namespace utils {
+// Picks the Matrix constructor that leaves elements uninitialized, for code
+// that is about to overwrite all of them anyway.
+struct UninitializedTag {};
+inline const UninitializedTag kUninitialized;
+}  // namespace utils
@@ -0,0 +1,612 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "kernels.hpp"
+#include "layout.hpp"
+
+namespace utils {
+
+// Columns factored per panel of the blocked LU. Everything right of a panel
+// is brought up to date with one GEMM, so wider panels push more of the
+// O(n^3) work into the multiplication kernel.
+const std::size_t kLuPanel = 64;
+
+template <typename T>
+T Magnitude(const T& value) {
+  return value < T() ? -value : value;
+}
+
+// Row-major copy of a rows x columns matrix, for the kernels below that
+// work on StridedBlock.
+template <typename Source>
+AlignedVector<ElementType<Source>> ToBuffer(const Source& source,
+                                            std::size_t rows,
+                                            std::size_t columns) {
+  AlignedVector<ElementType<Source>> buffer(rows * columns);
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t j = 0; j < columns; ++j) {
+      buffer[i * columns + j] = source(i, j);
+    }
+  }
+  return buffer;
+}
+
+template <typename T, typename Target>
+void FromBuffer(const AlignedVector<T>& buffer, Target& target,
+                std::size_t rows, std::size_t columns) {
+  for (std::size_t i = 0; i < rows; ++i) {
+    for (std::size_t j = 0; j < columns; ++j) {
+      target(i, j) = buffer[i * columns + j];
+    }
+  }
+}
+
+// dst -= factor * src for count elements.
+template <typename T>
+void SubtractScaled(T* dst, const T* src, const T& factor, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    dst[i] -= factor * src[i];
+  }
+}
+
+// Unblocked LU with partial pivoting of columns [begin, end) of a, rows
+// [begin, size). Pivot rows are swapped across the whole matrix, as LAPACK
+// does. Returns false if a pivot came out exactly zero.
+template <typename T>
+bool FactorizePanel(StridedBlock<T> a, std::size_t size, std::size_t begin,
+                    std::size_t end, std::size_t* pivots) {
+  bool regular = true;
+  for (std::size_t k = begin; k < end; ++k) {
+    std::size_t pivot = k;
+    for (std::size_t i = k + 1; i < size; ++i) {
+      if (Magnitude(a(pivot, k)) < Magnitude(a(i, k))) {
+        pivot = i;
+      }
+    }
+    pivots[k] = pivot;
+    if (pivot != k) {
+      std::swap_ranges(&a(k, 0), &a(k, 0) + size, &a(pivot, 0));
+    }
+    if (a(k, k) == T()) {
+      regular = false;
+      continue;
+    }
+    for (std::size_t i = k + 1; i < size; ++i) {
+      a(i, k) /= a(k, k);
+      SubtractScaled(&a(i, k + 1), &a(k, k + 1), a(i, k), end - k - 1);
+    }
+  }
+  return regular;
+}
+
+// In-place PA = LU of a size x size block: unit lower L below the diagonal,
+// U on and above it, row k swapped with pivots[k] at step k. Right-looking
+// and blocked: after each panel, the rows of U right of it come from a
+// triangular solve and the trailing matrix from a GEMM with the negated
+// panel of L. Returns false if the matrix is singular.
+template <typename T>
+bool FactorizeLu(StridedBlock<T> a, std::size_t size, std::size_t* pivots) {
+  bool regular = true;
+  AlignedVector<T> negated;
+  for (std::size_t begin = 0; begin < size; begin += kLuPanel) {
+    std::size_t end = std::min(begin + kLuPanel, size);
+    regular &= FactorizePanel(a, size, begin, end, pivots);
+    if (end == size) {
+      break;
+    }
+
+    for (std::size_t k = begin; k < end; ++k) {
+      for (std::size_t i = k + 1; i < end; ++i) {
+        SubtractScaled(&a(i, end), &a(k, end), a(i, k), size - end);
+      }
+    }
+
+    std::size_t rest = size - end;
+    std::size_t width = end - begin;
+    negated.resize(rest * width);
+    for (std::size_t i = 0; i < rest; ++i) {
+      for (std::size_t k = 0; k < width; ++k) {
+        negated[i * width + k] = -a(end + i, begin + k);
+      }
+    }
+    StridedBlock<T> trailing = a.Offset(end, end);
+    Multiply(StridedBlock<T>{negated.data(), width}, a.Offset(begin, end),
+             trailing, rest, width, rest);
+  }
+  return regular;
+}
+
+// Overwrites the size x columns block rhs with the solution of
+// (P^-1 L U) x = rhs for a factorization from FactorizeLu.
+template <typename Lu, typename T>
+void SolveLu(const Lu& lu, const std::size_t* pivots,
+             std::size_t size, StridedBlock<T> rhs, std::size_t columns) {
+  for (std::size_t k = 0; k < size; ++k) {
+    if (pivots[k] != k) {
+      std::swap_ranges(&rhs(k, 0), &rhs(k, 0) + columns, &rhs(pivots[k], 0));
+    }
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    for (std::size_t k = 0; k < i; ++k) {
+      SubtractScaled(&rhs(i, 0), &rhs(k, 0), lu(i, k), columns);
+    }
+  }
+  for (std::size_t i = size; i-- > 0;) {
+    for (std::size_t k = i + 1; k < size; ++k) {
+      SubtractScaled(&rhs(i, 0), &rhs(k, 0), lu(i, k), columns);
+    }
+    for (std::size_t j = 0; j < columns; ++j) {
+      rhs(i, j) /= lu(i, i);
+    }
+  }
+}
+
+// Products in Bareiss elimination exceed the final minors, so 64-bit
+// integers are widened for the intermediate step.
+template <typename T>
+using BareissType =
+    std::conditional_t<std::is_integral_v<T> && sizeof(T) <= sizeof(int64_t),
+                       __int128, T>;
+
+// dividend / divisor where the division is known to be exact. A T with a
+// DivExact (BigInt) uses it: it is cheaper than long division and right for
+// every sign, which BigInt's operator/ is not for long negative divisors.
+template <typename T>
+T ExactQuotient(const T& dividend, const T& divisor) {
+  return dividend / divisor;
+}
+
+template <typename T>
+  requires requires(T dividend, const T& divisor) {
+    dividend.DivExact(divisor);
+  }
+T ExactQuotient(const T& dividend, const T& divisor) {
+  T result = dividend;
+  result.DivExact(divisor);
+  return result;
+}
+
+// Fraction-free (Bareiss) elimination: every division is exact, so the
+// determinant of an integer matrix comes out exact. Destroys a.
+template <typename T>
+T BareissDeterminant(StridedBlock<T> a, std::size_t size) {
+  using Wide = BareissType<T>;
+  T previous = T(1);
+  bool negate = false;
+  for (std::size_t k = 0; k + 1 < size; ++k) {
+    if (a(k, k) == T()) {
+      std::size_t pivot = k + 1;
+      while (pivot < size && a(pivot, k) == T()) {
+        ++pivot;
+      }
+      if (pivot == size) {
+        return T();
+      }
+      std::swap_ranges(&a(k, 0), &a(k, 0) + size, &a(pivot, 0));
+      negate = !negate;
+    }
+    for (std::size_t i = k + 1; i < size; ++i) {
+      for (std::size_t j = k + 1; j < size; ++j) {
+        a(i, j) = static_cast<T>(ExactQuotient<Wide>(
+            Wide(a(i, j)) * Wide(a(k, k)) - Wide(a(i, k)) * Wide(a(k, j)),
+            Wide(previous)));
+      }
+    }
+    previous = a(k, k);
+  }
+  T result = size == 0 ? T(1) : a(size - 1, size - 1);
+  return negate ? -result : result;
+}
+
+// In-place lower Cholesky factor a = L L^T of a symmetric size x size
+// block; only the lower triangle is meaningful afterwards. Blocked like
+// FactorizeLu: the diagonal block is factored directly, the panel below it
+// by a triangular solve, and the trailing matrix is updated with a GEMM of
+// the negated panel by its transpose. Returns false if a is not positive
+// definite.
+template <typename T>
+bool FactorizeCholesky(StridedBlock<T> a, std::size_t size) {
+  AlignedVector<T> negated;
+  AlignedVector<T> transposed;
+  for (std::size_t begin = 0; begin < size; begin += kLuPanel) {
+    std::size_t end = std::min(begin + kLuPanel, size);
+    for (std::size_t j = begin; j < end; ++j) {
+      T diagonal = a(j, j);
+      for (std::size_t k = begin; k < j; ++k) {
+        diagonal -= a(j, k) * a(j, k);
+      }
+      if (!(T() < diagonal)) {
+        return false;
+      }
+      a(j, j) = std::sqrt(diagonal);
+      for (std::size_t i = j + 1; i < size; ++i) {
+        T elem = a(i, j);
+        for (std::size_t k = begin; k < j; ++k) {
+          elem -= a(i, k) * a(j, k);
+        }
+        a(i, j) = elem / a(j, j);
+      }
+    }
+    if (end == size) {
+      break;
+    }
+
+    std::size_t rest = size - end;
+    std::size_t width = end - begin;
+    negated.resize(rest * width);
+    transposed.resize(width * rest);
+    for (std::size_t i = 0; i < rest; ++i) {
+      for (std::size_t k = 0; k < width; ++k) {
+        negated[i * width + k] = -a(end + i, begin + k);
+        transposed[k * rest + i] = a(end + i, begin + k);
+      }
+    }
+    StridedBlock<T> trailing = a.Offset(end, end);
+    Multiply(StridedBlock<T>{negated.data(), width},
+             StridedBlock<T>{transposed.data(), rest}, trailing, rest, width,
+             rest);
+  }
+  return true;
+}
+
+// Overwrites the size x columns block rhs with the solution of
+// L L^T x = rhs, where lower(i, j) reads L for j <= i.
+template <typename Lower, typename T>
+void SolveCholesky(const Lower& lower, std::size_t size, StridedBlock<T> rhs,
+                   std::size_t columns) {
+  for (std::size_t i = 0; i < size; ++i) {
+    for (std::size_t k = 0; k < i; ++k) {
+      SubtractScaled(&rhs(i, 0), &rhs(k, 0), lower(i, k), columns);
+    }
+    for (std::size_t j = 0; j < columns; ++j) {
+      rhs(i, j) /= lower(i, i);
+    }
+  }
+  for (std::size_t i = size; i-- > 0;) {
+    for (std::size_t k = i + 1; k < size; ++k) {
+      SubtractScaled(&rhs(i, 0), &rhs(k, 0), lower(k, i), columns);
+    }
+    for (std::size_t j = 0; j < columns; ++j) {
+      rhs(i, j) /= lower(i, i);
+    }
+  }
+}
+
+// Householder reflector H = I - tau v v^T, v(0) = 1, taking column `column`
+// of a, rows [column, rows), to beta e_1. As in LAPACK's geqrf, beta goes on
+// the diagonal and v(1..) below it. Returns tau.
+template <typename T>
+T MakeReflector(StridedBlock<T> a, std::size_t rows, std::size_t column) {
+  T alpha = a(column, column);
+  T tail = T();
+  for (std::size_t i = column + 1; i < rows; ++i) {
+    tail += a(i, column) * a(i, column);
+  }
+  if (tail == T()) {
+    return T();
+  }
+  T beta = std::sqrt(alpha * alpha + tail);
+  if (T() < alpha) {
+    beta = -beta;
+  }
+  T scale = T(1) / (alpha - beta);
+  for (std::size_t i = column + 1; i < rows; ++i) {
+    a(i, column) *= scale;
+  }
+  a(column, column) = beta;
+  return (beta - alpha) / beta;
+}
+
+// Applies the reflector stored in column `column` of qr to columns
+// [begin, end) of target, rows [column, rows).
+template <typename Reflectors, typename T>
+void ApplyReflector(const Reflectors& qr, std::size_t rows, std::size_t column,
+                    const T& tau, StridedBlock<T> target, std::size_t begin,
+                    std::size_t end) {
+  if (tau == T()) {
+    return;
+  }
+  for (std::size_t j = begin; j < end; ++j) {
+    T dot = target(column, j);
+    for (std::size_t i = column + 1; i < rows; ++i) {
+      dot += qr(i, column) * target(i, j);
+    }
+    dot *= tau;
+    target(column, j) -= dot;
+    for (std::size_t i = column + 1; i < rows; ++i) {
+      target(i, j) -= dot * qr(i, column);
+    }
+  }
+}
+
+// In-place Householder QR of a rows x columns block, rows >= columns: R on
+// and above the diagonal, reflectors below it, their taus in taus. The
+// kLuPanel reflectors of a panel reach the rest of the matrix together, in
+// compact WY form Q_panel^T = I - V T^T V^T, as two GEMMs.
+template <typename T>
+void FactorizeQr(StridedBlock<T> a, std::size_t rows, std::size_t columns,
+                 T* taus) {
+  AlignedVector<T> negated;
+  AlignedVector<T> transposed;
+  AlignedVector<T> factor;
+  AlignedVector<T> product;
+  for (std::size_t begin = 0; begin < columns; begin += kLuPanel) {
+    std::size_t end = std::min(begin + kLuPanel, columns);
+    for (std::size_t k = begin; k < end; ++k) {
+      taus[k] = MakeReflector(a, rows, k);
+      ApplyReflector(a, rows, k, taus[k], a, k + 1, end);
+    }
+    if (end == columns) {
+      break;
+    }
+
+    // V with its unit diagonal and the zeros above it spelled out, once
+    // negated and once transposed for the two products
+    std::size_t height = rows - begin;
+    std::size_t width = end - begin;
+    negated.assign(height * width, T());
+    transposed.assign(width * height, T());
+    for (std::size_t i = 0; i < height; ++i) {
+      for (std::size_t k = 0; k < std::min(i + 1, width); ++k) {
+        T elem = (i == k ? T(1) : a(begin + i, begin + k));
+        negated[i * width + k] = -elem;
+        transposed[k * height + i] = elem;
+      }
+    }
+
+    // upper triangular T, column by column:
+    // T(0:k, k) = -tau_k T(0:k, 0:k) V(:, 0:k)^T v_k
+    factor.assign(width * width, T());
+    for (std::size_t k = 0; k < width; ++k) {
+      for (std::size_t i = 0; i < k; ++i) {
+        T dot = T();
+        for (std::size_t r = k; r < height; ++r) {
+          dot += transposed[i * height + r] * transposed[k * height + r];
+        }
+        factor[i * width + k] = dot;
+      }
+      // ascending i only reads entries at or below row i, still dots
+      for (std::size_t i = 0; i < k; ++i) {
+        T elem = T();
+        for (std::size_t l = i; l < k; ++l) {
+          elem += factor[i * width + l] * factor[l * width + k];
+        }
+        factor[i * width + k] = -taus[begin + k] * elem;
+      }
+      factor[k * width + k] = taus[begin + k];
+    }
+
+    // C -= V (T^T (V^T C)) for the columns right of the panel
+    std::size_t rest = columns - end;
+    StridedBlock<T> trailing = a.Offset(begin, end);
+    product.assign(width * rest, T());
+    StridedBlock<T> projected{product.data(), rest};
+    Multiply(StridedBlock<T>{transposed.data(), height}, trailing, projected,
+             width, height, rest);
+    for (std::size_t i = width; i-- > 0;) {
+      ScaleBy(&projected(i, 0), factor[i * width + i], rest);
+      for (std::size_t l = 0; l < i; ++l) {
+        SubtractScaled(&projected(i, 0), &projected(l, 0),
+                       -factor[l * width + i], rest);
+      }
+    }
+    Multiply(StridedBlock<T>{negated.data(), width}, projected, trailing,
+             height, width, rest);
+  }
+}
+
+// Overwrites the rows x columns block rhs with Q^T rhs for a factorization
+// from FactorizeQr with `count` reflectors.
+template <typename Reflectors, typename T>
+void ApplyQTransposed(const Reflectors& qr, const T* taus, std::size_t rows,
+                      std::size_t count, StridedBlock<T> rhs,
+                      std::size_t columns) {
+  for (std::size_t k = 0; k < count; ++k) {
+    ApplyReflector(qr, rows, k, taus[k], rhs, 0, columns);
+  }
+}
+
+// Overwrites the size x columns block rhs with the solution of R x = rhs,
+// where upper(i, j) reads R for j >= i. Returns false if some diagonal
+// element of R is within tolerance of zero.
+template <typename Upper, typename T>
+bool SolveUpper(const Upper& upper, std::size_t size, StridedBlock<T> rhs,
+                std::size_t columns, const T& tolerance) {
+  for (std::size_t i = size; i-- > 0;) {
+    if (!(tolerance < Magnitude(upper(i, i)))) {
+      return false;
+    }
+    for (std::size_t k = i + 1; k < size; ++k) {
+      SubtractScaled(&rhs(i, 0), &rhs(k, 0), upper(i, k), columns);
+    }
+    for (std::size_t j = 0; j < columns; ++j) {
+      rhs(i, j) /= upper(i, i);
+    }
+  }
+  return true;
+}
+
+}  // namespace utils
+
+// PA = LU of a square Matrix with partial pivoting, as returned by
+// Matrix::Lu(). T must support exact division (floating point or another
+// field); factor once and call Solve() for as many right-hand sides as needed.
+template <std::size_t N, typename T>
+struct LuDecomposition {
+  // Throws std::domain_error if the matrix is singular. The solution comes
+  // back in the layout of rhs.
+  template <std::size_t K, typename Layout>
+  Matrix<N, K, T, Layout> Solve(const Matrix<N, K, T, Layout>& rhs) const {
+    if (singular) {
+      throw std::domain_error("Matrix: singular system");
+    }
+    utils::AlignedVector<T> buffer(N * K);
+    for (std::size_t i = 0; i < N; ++i) {
+      for (std::size_t j = 0; j < K; ++j) {
+        buffer[i * K + j] = rhs(i, j);
+      }
+    }
+    utils::SolveLu(lu, pivots.data(), N,
+                   utils::StridedBlock<T>{buffer.data(), K}, K);
+    Matrix<N, K, T, Layout> result(utils::kUninitialized);
+    for (std::size_t i = 0; i < N; ++i) {
+      for (std::size_t j = 0; j < K; ++j) {
+        result(i, j) = buffer[i * K + j];
+      }
+    }
+    return result;
+  }
+
+  T Determinant() const {
+    if (singular) {
+      return T();
+    }
+    T result = T(1);
+    for (std::size_t i = 0; i < N; ++i) {
+      result *= lu(i, i);
+      if (pivots[i] != i) {
+        result = -result;
+      }
+    }
+    return result;
+  }
+
+  Matrix<N, N, T> lu;
+  std::array<std::size_t, N> pivots;
+  bool singular;
+};
+
+// Householder A = QR of a Matrix with at least as many rows as columns, as
+// returned by Matrix::Qr(): R on and above the diagonal of qr, the
+// reflectors that make up Q below it.
+template <std::size_t N, std::size_t M, typename T>
+struct QrDecomposition {
+  // the M x M upper triangular factor
+  Matrix<M, M, T> R() const {
+    Matrix<M, M, T> result;
+    for (std::size_t i = 0; i < M; ++i) {
+      for (std::size_t j = i; j < M; ++j) {
+        result(i, j) = qr(i, j);
+      }
+    }
+    return result;
+  }
+
+  // the N x M factor with orthonormal columns
+  Matrix<N, M, T> Q() const {
+    utils::AlignedVector<T> buffer(N * M, T());
+    for (std::size_t i = 0; i < M; ++i) {
+      buffer[i * M + i] = T(1);
+    }
+    for (std::size_t k = M; k-- > 0;) {
+      utils::ApplyReflector(qr, N, k, taus[k],
+                            utils::StridedBlock<T>{buffer.data(), M}, 0, M);
+    }
+    Matrix<N, M, T> result(utils::kUninitialized);
+    utils::FromBuffer(buffer, result, N, M);
+    return result;
+  }
+
+  // x minimizing the 2-norm of A x - rhs, column by column. Throws
+  // std::domain_error if A does not have full column rank, judged by the
+  // diagonal of R against N * epsilon times its largest element.
+  template <std::size_t K, typename Layout>
+  Matrix<M, K, T, Layout> SolveLeastSquares(
+      const Matrix<N, K, T, Layout>& rhs) const {
+    T largest = T();
+    for (std::size_t i = 0; i < M; ++i) {
+      largest = std::max(largest, utils::Magnitude(qr(i, i)));
+    }
+    T tolerance = largest * std::numeric_limits<T>::epsilon() * T(N);
+    utils::AlignedVector<T> buffer = utils::ToBuffer(rhs, N, K);
+    utils::StridedBlock<T> block{buffer.data(), K};
+    utils::ApplyQTransposed(qr, taus.data(), N, M, block, K);
+    if (!utils::SolveUpper(qr, M, block, K, tolerance)) {
+      throw std::domain_error("Matrix: rank-deficient least squares");
+    }
+    Matrix<M, K, T, Layout> result(utils::kUninitialized);
+    utils::FromBuffer(buffer, result, M, K);
+    return result;
+  }
+
+  Matrix<N, M, T> qr;
+  std::array<T, M> taus;
+};
+
+namespace utils {
+template <std::size_t N, typename T, typename Layout>
+LuDecomposition<N, T> Factorize(const Matrix<N, N, T, Layout>& matrix) {
+  AlignedVector<T> buffer = ToBuffer(matrix, N, N);
+  LuDecomposition<N, T> result;
+  result.singular =
+      !FactorizeLu(StridedBlock<T>{buffer.data(), N}, N, result.pivots.data());
+  FromBuffer(buffer, result.lu, N, N);
+  return result;
+}
+
+template <std::size_t N, typename T, typename Layout>
+T GetDeterminant(const Matrix<N, N, T, Layout>& matrix) {
+  // LU divides freely, which only floating point tolerates; any other T,
+  // big integers included, takes the Bareiss path, whose divisions are exact.
+  if (std::is_floating_point_v<T>) {
+    return Factorize(matrix).Determinant();
+  }
+  AlignedVector<T> buffer = ToBuffer(matrix, N, N);
+  return BareissDeterminant(StridedBlock<T>{buffer.data(), N}, N);
+}
+
+template <std::size_t N, typename T, typename Layout>
+Matrix<N, N, T, Layout> GetInverse(const Matrix<N, N, T, Layout>& matrix) {
+  Matrix<N, N, T, Layout> identity;
+  for (std::size_t i = 0; i < N; ++i) {
+    identity(i, i) = T(1);
+  }
+  return Factorize(matrix).Solve(identity);
+}
+
+template <std::size_t N, typename T, typename Layout>
+Matrix<N, N, T, Layout> GetCholesky(const Matrix<N, N, T, Layout>& matrix) {
+  AlignedVector<T> buffer = ToBuffer(matrix, N, N);
+  if (!FactorizeCholesky(StridedBlock<T>{buffer.data(), N}, N)) {
+    throw std::domain_error("Matrix: not positive definite");
+  }
+  Matrix<N, N, T, Layout> result;
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j <= i; ++j) {
+      result(i, j) = buffer[i * N + j];
+    }
+  }
+  return result;
+}
+
+template <std::size_t N, std::size_t K, typename T, typename Layout,
+          typename RhsLayout>
+Matrix<N, K, T, RhsLayout> SolvePositiveDefinite(
+    const Matrix<N, N, T, Layout>& matrix,
+    const Matrix<N, K, T, RhsLayout>& rhs) {
+  Matrix<N, N, T, Layout> lower = GetCholesky(matrix);
+  AlignedVector<T> buffer = ToBuffer(rhs, N, K);
+  SolveCholesky(lower, N, StridedBlock<T>{buffer.data(), K}, K);
+  Matrix<N, K, T, RhsLayout> result(kUninitialized);
+  FromBuffer(buffer, result, N, K);
+  return result;
+}
+
+template <std::size_t N, std::size_t M, typename T, typename Layout>
+QrDecomposition<N, M, T> GetQr(const Matrix<N, M, T, Layout>& matrix) {
+  AlignedVector<T> buffer = ToBuffer(matrix, N, M);
+  QrDecomposition<N, M, T> result;
+  FactorizeQr(StridedBlock<T>{buffer.data(), M}, N, M, result.taus.data());
+  FromBuffer(buffer, result.qr, N, M);
+  return result;
+}
+}  // namespace utils
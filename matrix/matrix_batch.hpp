@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "kernels.hpp"
+#include "matrix.hpp"
+#include "thread_pool.hpp"
+
+// A batch of same-sized N x M matrices stored structure-of-arrays: element
+// (i, j) of every matrix in the batch sits in one contiguous, cache-line
+// aligned array of lanes, lane b belonging to matrix b. Batched arithmetic
+// then runs SIMD across matrices instead of within one, which is what pays
+// off for the many small products (4 x 4, 8 x 8) of transform pipelines.
+// Batches of different sizes throw std::invalid_argument.
+template <std::size_t N, std::size_t M, typename T = int64_t>
+class MatrixBatch {
+ public:
+  explicit MatrixBatch(std::size_t size)
+      : size_(size), stride_(Padded(size)), buffer_(N * M * stride_, T()) {}
+
+  std::size_t Size() const { return size_; }
+
+  // element (row, column) of matrix index
+  T& operator()(std::size_t index, std::size_t row, std::size_t column) {
+    return Lanes(row, column)[index];
+  }
+  const T& operator()(std::size_t index, std::size_t row,
+                      std::size_t column) const {
+    return Lanes(row, column)[index];
+  }
+
+  // element (row, column) of every matrix, Size() of them in a row
+  T* Lanes(std::size_t row, std::size_t column) {
+    return buffer_.data() + (row * M + column) * stride_;
+  }
+  const T* Lanes(std::size_t row, std::size_t column) const {
+    return buffer_.data() + (row * M + column) * stride_;
+  }
+
+  Matrix<N, M, T> Get(std::size_t index) const {
+    Matrix<N, M, T> result(utils::kUninitialized);
+    for (std::size_t i = 0; i < N; ++i) {
+      for (std::size_t j = 0; j < M; ++j) {
+        result(i, j) = (*this)(index, i, j);
+      }
+    }
+    return result;
+  }
+
+  template <typename Layout>
+  void Set(std::size_t index, const Matrix<N, M, T, Layout>& matrix) {
+    for (std::size_t i = 0; i < N; ++i) {
+      for (std::size_t j = 0; j < M; ++j) {
+        (*this)(index, i, j) = matrix(i, j);
+      }
+    }
+  }
+
+  // matrix b of the result is left[b] * right[b]
+  template <std::size_t K>
+  friend MatrixBatch<N, K, T> operator*(const MatrixBatch& left,
+                                        const MatrixBatch<M, K, T>& right) {
+    MatrixBatch<N, K, T> result(CheckSize(left, right));
+    Multiply(left, right, result);
+    return result;
+  }
+
+  // The same into an existing batch of the same size, so that a pipeline
+  // can reuse its buffers instead of allocating a batch per step.
+  template <std::size_t K>
+  friend void Multiply(const MatrixBatch& left,
+                       const MatrixBatch<M, K, T>& right,
+                       MatrixBatch<N, K, T>& result) {
+    std::size_t size = CheckSize(left, right);
+    if (result.Size() != size) {
+      throw std::invalid_argument("MatrixBatch: batch sizes differ");
+    }
+    utils::MultiplyBatch<N, M, K>(left.Lanes(0, 0), right.Lanes(0, 0),
+                                  result.Lanes(0, 0), Padded(size), 0, size);
+  }
+
+  // The same, with disjoint ranges of lanes spread over the pool.
+  template <std::size_t K>
+  friend MatrixBatch<N, K, T> Multiply(const MatrixBatch& left,
+                                       const MatrixBatch<M, K, T>& right,
+                                       ThreadPool& pool) {
+    MatrixBatch<N, K, T> result(CheckSize(left, right));
+    std::size_t parts = pool.Size() * kTasksPerThread;
+    std::size_t chunk = Padded((left.Size() + parts - 1) / parts);
+    std::vector<std::function<void()>> tasks;
+    for (std::size_t begin = 0; begin < left.Size(); begin += chunk) {
+      std::size_t end = std::min(begin + chunk, left.Size());
+      tasks.emplace_back([&left, &right, &result, begin, end] {
+        utils::MultiplyBatch<N, M, K>(left.Lanes(0, 0), right.Lanes(0, 0),
+                                      result.Lanes(0, 0), Padded(left.Size()),
+                                      begin, end);
+      });
+    }
+    pool.Run(std::move(tasks));
+    return result;
+  }
+
+ private:
+  // tasks per pool thread, so that a late start on one thread evens out
+  static const std::size_t kTasksPerThread = 4;
+
+  // distance between the lane arrays of two elements: size rounded up to
+  // whole cache lines, so that every lane array starts on a cache line and
+  // batches of one size share it
+  static std::size_t Padded(std::size_t size) {
+    std::size_t lanes =
+        std::max<std::size_t>(utils::kCacheLine / sizeof(T), 1);
+    return (size + lanes - 1) / lanes * lanes;
+  }
+
+  template <std::size_t K>
+  static std::size_t CheckSize(const MatrixBatch& left,
+                               const MatrixBatch<M, K, T>& right) {
+    if (left.Size() != right.Size()) {
+      throw std::invalid_argument("MatrixBatch: batch sizes differ");
+    }
+    return left.Size();
+  }
+
+  std::size_t size_;
+  std::size_t stride_;
+  utils::AlignedVector<T> buffer_;
+};
@@ -0,0 +1,190 @@
+// Build with Google Benchmark installed:
+//   g++ -std=c++20 -O2 matrix_benchmark.cpp -lbenchmark -lpthread
+//       -o matrix_benchmark
+// Results for tracking go to JSON:
+//   ./matrix_benchmark --benchmark_out=bench_output.json
+//       --benchmark_out_format=json
+//
+// BmMultiplyParallel scales a 2048 x 2048 double product from one thread up
+// to std::thread::hardware_concurrency(); the argument is the thread count.
+// Speedup is the ratio of real times, the "flops" counter is the rate (for
+// Strassen it is the classical 2n^3 count, so it reads as an effective rate).
+// The semiring benchmarks count 2n^3 semiring operations as "flops"; the
+// boolean one multiplies a random graph with one edge in 64 by itself.
+// The 4 x 4 benchmarks multiply kTransforms pairs of float matrices, one
+// Matrix at a time and as one MatrixBatch; kTransforms keeps the operands in
+// L2, far beyond that both run at memory bandwidth.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <thread>
+
+#include "dynamic_matrix.hpp"
+#include "matrix_batch.hpp"
+#include "sparse_matrix.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+const std::size_t kSize = 2048;
+
+DynamicMatrix<double> MakeMatrix(std::size_t size, uint64_t seed) {
+  std::mt19937_64 generator(seed);
+  std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+  DynamicMatrix<double> matrix(size, size);
+  for (std::size_t i = 0; i < size; ++i) {
+    for (std::size_t j = 0; j < size; ++j) {
+      matrix(i, j) = distribution(generator);
+    }
+  }
+  return matrix;
+}
+
+void SetFlops(benchmark::State& state, std::size_t size) {
+  state.counters["flops"] = benchmark::Counter(
+      2.0 * size * size * size * state.iterations(),
+      benchmark::Counter::kIsRate);
+}
+
+void BmMultiply(benchmark::State& state) {
+  std::size_t size = state.range(0);
+  DynamicMatrix<double> left = MakeMatrix(size, 1);
+  DynamicMatrix<double> right = MakeMatrix(size, 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(left * right);
+  }
+  SetFlops(state, size);
+}
+BENCHMARK(BmMultiply)
+    ->RangeMultiplier(2)
+    ->Range(64, kSize)
+    ->Unit(benchmark::kMillisecond);
+
+void BmStrassenMultiply(benchmark::State& state) {
+  std::size_t size = state.range(0);
+  DynamicMatrix<double> left = MakeMatrix(size, 1);
+  DynamicMatrix<double> right = MakeMatrix(size, 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(StrassenMultiply(left, right));
+  }
+  SetFlops(state, size);
+}
+BENCHMARK(BmStrassenMultiply)
+    ->RangeMultiplier(2)
+    ->Range(512, kSize)
+    ->Unit(benchmark::kMillisecond);
+
+void BmMultiplyParallel(benchmark::State& state) {
+  DynamicMatrix<double> left = MakeMatrix(kSize, 1);
+  DynamicMatrix<double> right = MakeMatrix(kSize, 2);
+  ThreadPool pool(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Multiply(left, right, pool));
+  }
+  SetFlops(state, kSize);
+}
+BENCHMARK(BmMultiplyParallel)
+    ->RangeMultiplier(2)
+    ->Range(1, std::max(1U, std::thread::hardware_concurrency()))
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+void BmMinPlusMultiply(benchmark::State& state) {
+  std::size_t size = state.range(0);
+  DynamicMatrix<double> left = MakeMatrix(size, 1);
+  DynamicMatrix<double> right = MakeMatrix(size, 2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Multiply<MinPlus>(left, right));
+  }
+  SetFlops(state, size);
+}
+BENCHMARK(BmMinPlusMultiply)
+    ->RangeMultiplier(2)
+    ->Range(64, kSize)
+    ->Unit(benchmark::kMillisecond);
+
+void BmBooleanMultiply(benchmark::State& state) {
+  std::size_t size = state.range(0);
+  std::mt19937_64 generator(4);
+  DynamicMatrix<uint8_t> graph(size, size);
+  for (std::size_t i = 0; i < size; ++i) {
+    for (std::size_t j = 0; j < size; ++j) {
+      graph(i, j) = (generator() % 64 == 0);
+    }
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Multiply<OrAnd>(graph, graph));
+  }
+  SetFlops(state, size);
+}
+BENCHMARK(BmBooleanMultiply)
+    ->RangeMultiplier(2)
+    ->Range(512, kSize)
+    ->Unit(benchmark::kMillisecond);
+
+// Random graph with kSparseDegree edges per vertex, as a CSR matrix.
+const std::size_t kSparseVertices = 1 << 20;
+const std::size_t kSparseDegree = 16;
+
+void BmSparseMultiplyVector(benchmark::State& state) {
+  std::mt19937_64 generator(3);
+  std::vector<SparseMatrix<double>::Triplet> edges;
+  for (std::size_t i = 0; i < kSparseVertices; ++i) {
+    for (std::size_t k = 0; k < kSparseDegree; ++k) {
+      edges.push_back({i, generator() % kSparseVertices, 1.0});
+    }
+  }
+  SparseMatrix<double> graph(kSparseVertices, kSparseVertices, edges);
+  std::vector<double> vector(kSparseVertices, 1.0);
+  ThreadPool pool(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Multiply(graph, vector, pool));
+  }
+  state.counters["nnz"] = benchmark::Counter(
+      graph.NonZeros() * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BmSparseMultiplyVector)
+    ->RangeMultiplier(2)
+    ->Range(1, std::max(1U, std::thread::hardware_concurrency()))
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+const std::size_t kTransforms = 1 << 12;
+
+void BmSmallMultiply(benchmark::State& state) {
+  std::vector<Matrix<4, 4, float>> left(kTransforms, Matrix<4, 4, float>(1));
+  std::vector<Matrix<4, 4, float>> right(kTransforms, Matrix<4, 4, float>(2));
+  std::vector<Matrix<4, 4, float>> result(kTransforms);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < kTransforms; ++i) {
+      result[i] = left[i] * right[i];
+    }
+    benchmark::DoNotOptimize(result.data());
+  }
+  state.counters["products"] = benchmark::Counter(
+      kTransforms * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BmSmallMultiply)->Unit(benchmark::kMicrosecond);
+
+void BmBatchMultiply(benchmark::State& state) {
+  MatrixBatch<4, 4, float> left(kTransforms);
+  MatrixBatch<4, 4, float> right(kTransforms);
+  MatrixBatch<4, 4, float> result(kTransforms);
+  for (std::size_t i = 0; i < kTransforms; ++i) {
+    left.Set(i, Matrix<4, 4, float>(1));
+    right.Set(i, Matrix<4, 4, float>(2));
+  }
+  for (auto _ : state) {
+    Multiply(left, right, result);
+    benchmark::DoNotOptimize(result.Lanes(0, 0));
+  }
+  state.counters["products"] = benchmark::Counter(
+      kTransforms * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BmBatchMultiply)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,1023 @@
+// Build and run:
+//   g++ -std=c++20 -O2 -Wall -Wextra matrix_test.cpp
+//       ../big_integer/big_integer.cpp -lpthread -o matrix_test &&
+//       ./matrix_test
+// Every check is an assert, so build without NDEBUG. A hang means a lost
+// wake-up or a miscounted task in ThreadPool.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "../big_integer/big_integer.hpp"
+#include "matrix.hpp"
+#include "matrix_batch.hpp"
+#include "matrix_view.hpp"
+#include "sparse_matrix.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+// Many small batches back to back, each one racing the workers that are
+// still sweeping the deques for the previous batch, then the pool is
+// destroyed, which only returns once every worker has seen the queue empty.
+void TestPoolStress() {
+  const std::size_t kPools = 20;
+  const std::size_t kBatches = 2000;
+  for (std::size_t pool_index = 0; pool_index < kPools; ++pool_index) {
+    auto* pool = new ThreadPool(4);
+    std::atomic<std::size_t> counter = 0;
+    std::size_t expected = 0;
+    for (std::size_t batch = 0; batch < kBatches; ++batch) {
+      std::size_t size = 1 + batch % 23;
+      std::vector<std::function<void()>> tasks;
+      for (std::size_t i = 0; i < size; ++i) {
+        tasks.emplace_back([&counter] { ++counter; });
+      }
+      pool->Run(std::move(tasks));
+      expected += size;
+      assert(counter == expected);
+    }
+    delete pool;
+  }
+}
+
+// Uniform integers in [-range, range] as T, the same on every run.
+template <std::size_t N, std::size_t M, typename T, typename Layout>
+void FillRandom(Matrix<N, M, T, Layout>& matrix, std::mt19937_64& random,
+                int64_t range) {
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < M; ++j) {
+      matrix(i, j) = T(int64_t(random() % (2 * range + 1)) - range);
+    }
+  }
+}
+
+// The textbook triple loop, the reference for every product below.
+template <std::size_t N, std::size_t M, std::size_t K, typename T,
+          typename LeftLayout, typename RightLayout>
+Matrix<N, K, T> NaiveProduct(const Matrix<N, M, T, LeftLayout>& left,
+                             const Matrix<M, K, T, RightLayout>& right) {
+  Matrix<N, K, T> result;
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < K; ++j) {
+      for (std::size_t k = 0; k < M; ++k) {
+        result(i, j) += left(i, k) * right(k, j);
+      }
+    }
+  }
+  return result;
+}
+
+// Largest |left(i, j) - right(i, j)|.
+template <std::size_t N, std::size_t M, typename LeftLayout,
+          typename RightLayout>
+double MaxDifference(const Matrix<N, M, double, LeftLayout>& left,
+                     const Matrix<N, M, double, RightLayout>& right) {
+  double result = 0;
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < M; ++j) {
+      result = std::max(result, std::abs(left(i, j) - right(i, j)));
+    }
+  }
+  return result;
+}
+
+template <std::size_t N>
+Matrix<N, N, double> Identity() {
+  Matrix<N, N, double> result;
+  for (std::size_t i = 0; i < N; ++i) {
+    result(i, i) = 1;
+  }
+  return result;
+}
+
+// Element type that counts default constructions: every Matrix<..., Counted>
+// default-constructs all of its elements, so the count tells how many
+// matrices an expression built.
+struct Counted {
+  static std::size_t constructed;
+
+  Counted() { ++constructed; }
+  Counted(int64_t value) : value(value) {}
+
+  Counted operator+(const Counted& other) const { return value + other.value; }
+  Counted operator-(const Counted& other) const { return value - other.value; }
+  Counted operator*(const Counted& other) const { return value * other.value; }
+  bool operator==(const Counted& other) const = default;
+
+  int64_t value = 0;
+};
+
+std::size_t Counted::constructed = 0;
+
+// A + B - C * 2 is one tree of nodes, evaluated in a single pass into the
+// matrix it initializes.
+void TestExpressionsAreLazy() {
+  Matrix<2, 2, Counted> a({{1, 2}, {3, 4}});
+  Matrix<2, 2, Counted> b({{5, 6}, {7, 8}});
+  Matrix<2, 2, Counted> c({{1, 1}, {2, 2}});
+  using Expression = decltype(a + b - c * 2);
+  assert(!utils::IsMatrix<Expression>::value);
+  Counted::constructed = 0;
+  Matrix<2, 2, Counted> result = a + b - c * 2;
+  assert(Counted::constructed == 4);
+  Matrix<2, 2, Counted> expected({{4, 6}, {6, 8}});
+  assert(result == expected);
+}
+
+// Nodes keep temporaries by value, so an expression held in auto outlives
+// the Matrix that `a + 5` converts 5 to; it also has Transposed() and
+// Trace(), and mixes layouts.
+void TestExpressionOperands() {
+  Matrix<2, 3, int> a({{1, 2, 3}, {4, 5, 6}});
+  Matrix<2, 3, int> b({{1, 1, 1}, {1, 1, 1}});
+  auto shifted = a + 5;
+  auto twice = (a * 2 + Matrix<2, 3, int>(1)) * 2;
+  Matrix<2, 3, int> copy = shifted;
+  Matrix<2, 3, int> doubled = twice;
+  assert(copy(1, 2) == 11 && doubled(1, 2) == 26);
+  assert((a + b).Transposed()(2, 1) == 7);
+  Matrix<2, 2, int> square({{1, 2}, {3, 4}});
+  assert((square * 2 - square).Trace() == 5);
+
+  Matrix<2, 3, int, ColumnMajor> ones(b);
+  Matrix<2, 3, int> mixed = a + ones - ones;
+  Matrix<2, 3, int, ColumnMajor> mixed_column(ones + a - ones);
+  assert(mixed == a && mixed_column == a && a + ones == a + b);
+  Matrix<3, 2, int> right({{1, 0}, {0, 1}, {1, 1}});
+  Matrix<2, 3, int> sum = a + b;
+  assert((a + b) * right == sum * right);
+}
+
+// Determinant by cofactor expansion along the first row, the reference for
+// small matrices.
+template <typename T>
+T LaplaceDeterminant(const std::vector<std::vector<T>>& matrix) {
+  if (matrix.size() == 1) {
+    return matrix[0][0];
+  }
+  T result(0);
+  for (std::size_t column = 0; column < matrix.size(); ++column) {
+    std::vector<std::vector<T>> minor;
+    for (std::size_t i = 1; i < matrix.size(); ++i) {
+      minor.emplace_back(matrix[i]);
+      minor.back().erase(minor.back().begin() + column);
+    }
+    T term = matrix[0][column] * LaplaceDeterminant(minor);
+    result = (column % 2 == 0 ? result + term : result - term);
+  }
+  return result;
+}
+
+// A class-type integer must take the exact Bareiss path: LU would divide
+// 1 / 2 to 0 and report 6 for this singular matrix.
+void TestBigIntDeterminant() {
+  Matrix<3, 3, BigInt> singular(
+      {{BigInt(2), BigInt(0), BigInt(1)},
+       {BigInt(1), BigInt(3), BigInt(2)},
+       {BigInt(1), BigInt(1), BigInt(1)}});
+  assert(singular.Determinant() == BigInt(0));
+
+  Matrix<3, 3, BigInt> regular(
+      {{BigInt(0), BigInt(2), BigInt(1)},
+       {BigInt(3), BigInt(1), BigInt(4)},
+       {BigInt(5), BigInt(9), BigInt(2)}});
+  assert(regular.Determinant() == BigInt(50));
+
+  // Entries up to 1e9 in magnitude: the Bareiss pivots pass 18 digits and
+  // take both signs, so the exact divisions run on long negative divisors.
+  const std::size_t kSize = 6;
+  std::mt19937_64 random(40);
+  for (std::size_t trial = 0; trial < 30; ++trial) {
+    std::vector<std::vector<BigInt>> rows(kSize, std::vector<BigInt>(kSize));
+    for (auto& row : rows) {
+      for (auto& element : row) {
+        element = BigInt(int64_t(random() % 2000000001) - 1000000000);
+      }
+    }
+    Matrix<kSize, kSize, BigInt> matrix(rows);
+    assert(matrix.Determinant() == LaplaceDeterminant(rows));
+  }
+}
+
+// P A = L U for the LAPACK-style row swaps in pivots, and Solve() and
+// Inverse() leave small residuals. The matrix is made diagonally dominant
+// so that it is well conditioned at every size.
+template <std::size_t N>
+void CheckLu(std::mt19937_64& random) {
+  Matrix<N, N, double> a;
+  FillRandom(a, random, 9);
+  for (std::size_t i = 0; i < N; ++i) {
+    a(i, i) += 10.0 * N;
+  }
+  LuDecomposition<N, double> lu = a.Lu();
+  assert(!lu.singular);
+  Matrix<N, N, double> lower = Identity<N>();
+  Matrix<N, N, double> upper;
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < N; ++j) {
+      (j < i ? lower : upper)(i, j) = lu.lu(i, j);
+    }
+  }
+  Matrix<N, N, double> permuted = a;
+  for (std::size_t k = 0; k < N; ++k) {
+    for (std::size_t j = 0; j < N; ++j) {
+      std::swap(permuted(k, j), permuted(lu.pivots[k], j));
+    }
+  }
+  assert(MaxDifference(NaiveProduct(lower, upper), permuted) < 1e-9);
+
+  Matrix<N, 3, double> rhs;
+  FillRandom(rhs, random, 9);
+  assert(MaxDifference(NaiveProduct(a, a.Solve(rhs)), rhs) < 1e-9);
+  assert(MaxDifference(NaiveProduct(a, a.Inverse()), Identity<N>()) < 1e-9);
+}
+
+// Sizes on both sides of one LU panel (kLuPanel = 64) and across several.
+void TestLinearSystems() {
+  std::mt19937_64 random(40);
+  CheckLu<1>(random);
+  CheckLu<5>(random);
+  CheckLu<64>(random);
+  CheckLu<130>(random);
+
+  for (std::size_t trial = 0; trial < 20; ++trial) {
+    Matrix<5, 5> integer;
+    FillRandom(integer, random, 9);
+    std::vector<std::vector<int64_t>> rows(5, std::vector<int64_t>(5));
+    Matrix<5, 5, double> floating;
+    for (std::size_t i = 0; i < 5; ++i) {
+      for (std::size_t j = 0; j < 5; ++j) {
+        rows[i][j] = integer(i, j);
+        floating(i, j) = double(integer(i, j));
+      }
+    }
+    int64_t expected = LaplaceDeterminant(rows);
+    assert(integer.Determinant() == expected);
+    assert(std::abs(floating.Determinant() - double(expected)) < 1e-6);
+  }
+
+  Matrix<3, 3, double> singular({{1, 2, 3}, {2, 4, 6}, {1, 1, 1}});
+  Matrix<3, 1, double> rhs({{1}, {2}, {3}});
+  bool solve_threw = false;
+  bool inverse_threw = false;
+  try {
+    singular.Solve(rhs);
+  } catch (const std::domain_error&) {
+    solve_threw = true;
+  }
+  try {
+    singular.Inverse();
+  } catch (const std::domain_error&) {
+    inverse_threw = true;
+  }
+  assert(solve_threw && inverse_threw);
+  Matrix<3, 3> singular_integer({{1, 2, 3}, {2, 4, 6}, {1, 1, 1}});
+  assert(singular_integer.Determinant() == 0);
+}
+
+// Cholesky of B^T B + N I: L is lower triangular and L L^T gives the
+// matrix back; SolvePositiveDefinite() leaves a small residual.
+template <std::size_t N>
+void CheckCholesky(std::mt19937_64& random) {
+  Matrix<N, N, double> b;
+  FillRandom(b, random, 9);
+  Matrix<N, N, double> a = NaiveProduct(b.Transposed(), b);
+  for (std::size_t i = 0; i < N; ++i) {
+    a(i, i) += double(N);
+  }
+  Matrix<N, N, double> lower = a.Cholesky();
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = i + 1; j < N; ++j) {
+      assert(lower(i, j) == 0);
+    }
+  }
+  assert(MaxDifference(NaiveProduct(lower, lower.Transposed()), a) < 1e-8);
+  Matrix<N, 2, double> rhs;
+  FillRandom(rhs, random, 9);
+  assert(MaxDifference(NaiveProduct(a, a.SolvePositiveDefinite(rhs)), rhs) <
+         1e-8);
+}
+
+// Q has orthonormal columns, R is upper triangular, Q R is the matrix, and
+// the least-squares residual is orthogonal to every column.
+template <std::size_t N, std::size_t M>
+void CheckQr(std::mt19937_64& random) {
+  Matrix<N, M, double> a;
+  FillRandom(a, random, 9);
+  QrDecomposition<N, M, double> qr = a.Qr();
+  Matrix<N, M, double> q = qr.Q();
+  Matrix<M, M, double> r = qr.R();
+  for (std::size_t i = 0; i < M; ++i) {
+    for (std::size_t j = 0; j < i; ++j) {
+      assert(r(i, j) == 0);
+    }
+  }
+  assert(MaxDifference(NaiveProduct(q.Transposed(), q), Identity<M>()) <
+         1e-12);
+  assert(MaxDifference(NaiveProduct(q, r), a) < 1e-10);
+
+  Matrix<N, 1, double> rhs;
+  FillRandom(rhs, random, 9);
+  Matrix<M, 1, double> x = a.SolveLeastSquares(rhs);
+  Matrix<N, 1, double> residual = NaiveProduct(a, x);
+  for (std::size_t i = 0; i < N; ++i) {
+    residual(i, 0) -= rhs(i, 0);
+  }
+  Matrix<M, 1, double> zero;
+  assert(MaxDifference(NaiveProduct(a.Transposed(), residual), zero) < 1e-9);
+}
+
+// Sizes on both sides of one panel (the blocked factorizations share
+// kLuPanel = 64), square and tall QR, and the error cases.
+void TestOrthogonalAndCholesky() {
+  std::mt19937_64 random(41);
+  CheckCholesky<1>(random);
+  CheckCholesky<7>(random);
+  CheckCholesky<64>(random);
+  CheckCholesky<150>(random);
+  CheckQr<1, 1>(random);
+  CheckQr<5, 3>(random);
+  CheckQr<64, 64>(random);
+  CheckQr<150, 70>(random);
+
+  Matrix<2, 2, double> indefinite({{1, 2}, {2, 1}});
+  bool cholesky_threw = false;
+  try {
+    indefinite.Cholesky();
+  } catch (const std::domain_error&) {
+    cholesky_threw = true;
+  }
+  assert(cholesky_threw);
+
+  Matrix<3, 2, double> rank_deficient({{1, 2}, {2, 4}, {3, 6}});
+  Matrix<3, 1, double> rhs({{1}, {2}, {4}});
+  bool least_squares_threw = false;
+  try {
+    rank_deficient.SolveLeastSquares(rhs);
+  } catch (const std::domain_error&) {
+    least_squares_threw = true;
+  }
+  assert(least_squares_threw);
+}
+
+// left * right with every element reduced into [0, modulus), through
+// 128-bit products so that moduli up to 2^63 cannot overflow.
+template <std::size_t N>
+Matrix<N, N> NaiveProductMod(const Matrix<N, N>& left,
+                             const Matrix<N, N>& right, int64_t modulus) {
+  Matrix<N, N> result;
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < N; ++j) {
+      __int128 sum = 0;
+      for (std::size_t k = 0; k < N; ++k) {
+        sum = (sum + __int128(left(i, k)) * right(k, j)) % modulus;
+      }
+      result(i, j) = int64_t((sum + modulus) % modulus);
+    }
+  }
+  return result;
+}
+
+// Pow and PowMod against repeated multiplication, including exponents 0 and
+// 1, negative entries and a modulus close to 2^62; Fibonacci numbers as
+// known values.
+void TestPowers() {
+  Matrix<2, 2> fibonacci({{1, 1}, {1, 0}});
+  int64_t previous = 0;
+  int64_t current = 1;
+  for (uint64_t n = 1; n <= 90; ++n) {
+    assert(fibonacci.Pow(n)(0, 1) == current);
+    int64_t next = previous + current;
+    previous = current;
+    current = next;
+  }
+  const int64_t kPrime = 1000000007;
+  previous = 0;
+  current = 1;
+  for (uint64_t n = 1; n <= 2000; ++n) {
+    assert(fibonacci.PowMod(n, kPrime)(0, 1) == current);
+    int64_t next = (previous + current) % kPrime;
+    previous = current;
+    current = next;
+  }
+
+  std::mt19937_64 random(42);
+  Matrix<5, 5> base;
+  FillRandom(base, random, 3);
+  Matrix<5, 5> identity;
+  for (std::size_t i = 0; i < 5; ++i) {
+    identity(i, i) = 1;
+  }
+  assert(base.Pow(0) == identity && base.Pow(1) == base);
+  Matrix<5, 5> expected = base;
+  for (uint64_t n = 2; n <= 12; ++n) {
+    expected = NaiveProduct(expected, base);
+    assert(base.Pow(n) == expected);
+  }
+
+  for (int64_t modulus : {int64_t(2), kPrime, (int64_t(1) << 62) - 57}) {
+    Matrix<5, 5> reduced = base;
+    for (std::size_t i = 0; i < 5; ++i) {
+      for (std::size_t j = 0; j < 5; ++j) {
+        reduced(i, j) = (base(i, j) % modulus + modulus) % modulus;
+      }
+    }
+    Matrix<5, 5> one;
+    for (std::size_t i = 0; i < 5; ++i) {
+      one(i, i) = 1 % modulus;
+    }
+    assert(base.PowMod(0, modulus) == one);
+    assert(base.PowMod(1, modulus) == reduced);
+    Matrix<5, 5> power = reduced;
+    for (uint64_t n = 2; n <= 40; ++n) {
+      power = NaiveProductMod(power, reduced, modulus);
+      assert(base.PowMod(n, modulus) == power);
+    }
+    // (A^e)^2 == A^(2e) for an exponent far beyond repeated multiplication
+    Matrix<5, 5> large = base.PowMod(1000000000000000003ULL, modulus);
+    assert(NaiveProductMod(large, large, modulus) ==
+           base.PowMod(2000000000000000006ULL, modulus));
+  }
+
+  bool threw = false;
+  try {
+    base.PowMod(3, 0);
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+DynamicMatrix<int64_t> NaiveProduct(const DynamicMatrix<int64_t>& left,
+                                    const DynamicMatrix<int64_t>& right) {
+  DynamicMatrix<int64_t> result(left.Rows(), right.Columns());
+  for (std::size_t i = 0; i < left.Rows(); ++i) {
+    for (std::size_t j = 0; j < right.Columns(); ++j) {
+      for (std::size_t k = 0; k < left.Columns(); ++k) {
+        result(i, j) += left(i, k) * right(k, j);
+      }
+    }
+  }
+  return result;
+}
+
+// Both compressions of random matrices with repeated triplets agree with the
+// dense matrix they sum to, convert into each other, and multiply vectors
+// and dense matrices like it does, serially and over pools of any size.
+void TestSparseMatrix() {
+  using Sparse = SparseMatrix<int64_t>;
+  std::mt19937_64 random(43);
+  const std::size_t kShapes[][2] = {{1, 1}, {7, 5}, {100, 64}, {33, 257}};
+  for (const auto& shape : kShapes) {
+    std::size_t rows = shape[0];
+    std::size_t columns = shape[1];
+    std::vector<Sparse::Triplet> triplets;
+    DynamicMatrix<int64_t> dense(rows, columns);
+    for (std::size_t k = 0; k < rows * columns / 10 + 3; ++k) {
+      Sparse::Triplet triplet{random() % rows, random() % columns,
+                              int64_t(random() % 19) - 9};
+      triplets.push_back(triplet);
+      dense(triplet.row, triplet.column) += triplet.value;
+    }
+    Sparse csr(rows, columns, triplets);
+    Sparse csc(rows, columns, triplets, Sparse::Format::kCsc);
+    assert(csr.ToDense() == dense && csc.ToDense() == dense);
+    assert(csr.Converted(Sparse::Format::kCsc) == csc);
+    assert(csc.Converted(Sparse::Format::kCsr) == csr);
+    assert(Sparse(dense).ToDense() == dense);
+    for (std::size_t i = 0; i < rows; ++i) {
+      for (std::size_t j = 0; j < columns; ++j) {
+        assert(csr(i, j) == dense(i, j) && csc(i, j) == dense(i, j));
+      }
+    }
+
+    std::vector<int64_t> vector(columns);
+    DynamicMatrix<int64_t> column(columns, 1);
+    for (std::size_t j = 0; j < columns; ++j) {
+      vector[j] = int64_t(random() % 101) - 50;
+      column(j, 0) = vector[j];
+    }
+    DynamicMatrix<int64_t> product = NaiveProduct(dense, column);
+    std::vector<int64_t> expected(rows);
+    for (std::size_t i = 0; i < rows; ++i) {
+      expected[i] = product(i, 0);
+    }
+    DynamicMatrix<int64_t> right(columns, 37);
+    for (std::size_t i = 0; i < columns; ++i) {
+      for (std::size_t j = 0; j < 37; ++j) {
+        right(i, j) = int64_t(random() % 21) - 10;
+      }
+    }
+    DynamicMatrix<int64_t> expected_dense = NaiveProduct(dense, right);
+    assert(csr * vector == expected && csc * vector == expected);
+    assert(csr * right == expected_dense && csc * right == expected_dense);
+    for (std::size_t threads : {1, 3, 8}) {
+      ThreadPool pool(threads);
+      assert(Multiply(csr, vector, pool) == expected);
+      assert(Multiply(csc, vector, pool) == expected);
+      assert(Multiply(csr, right, pool) == expected_dense);
+      assert(Multiply(csc, right, pool) == expected_dense);
+    }
+  }
+
+  bool out_of_range = false;
+  try {
+    Sparse(2, 2, {{2, 0, 1}});
+  } catch (const std::invalid_argument&) {
+    out_of_range = true;
+  }
+  bool mismatch = false;
+  try {
+    Sparse(2, 3, {{0, 0, 1}}) * std::vector<int64_t>(2);
+  } catch (const std::invalid_argument&) {
+    mismatch = true;
+  }
+  assert(out_of_range && mismatch);
+}
+
+// A view of a 7 x 9 matrix in Layout has the layout's strides, reads and
+// writes the matrix's own elements, and its blocks, rows, columns and
+// transpose address the right ones; arithmetic on a block matches the
+// same arithmetic on a copy of it.
+template <typename Layout>
+void CheckView(std::size_t row_stride, std::size_t column_stride,
+               std::mt19937_64& random) {
+  Matrix<7, 9, int64_t, Layout> matrix;
+  FillRandom(matrix, random, 50);
+  MatrixView<int64_t> view(matrix);
+  assert(view.Rows() == 7 && view.Columns() == 9);
+  assert(view.RowStride() == row_stride);
+  assert(view.ColumnStride() == column_stride);
+
+  MatrixView<int64_t> block = view.Block(2, 3, 4, 5);
+  MatrixView<int64_t> transposed = block.Transposed();
+  for (std::size_t i = 0; i < 4; ++i) {
+    for (std::size_t j = 0; j < 5; ++j) {
+      assert(block(i, j) == matrix(2 + i, 3 + j));
+      assert(transposed(j, i) == matrix(2 + i, 3 + j));
+      assert(block.Row(i)(0, j) == matrix(2 + i, 3 + j));
+      assert(block.Column(j)(i, 0) == matrix(2 + i, 3 + j));
+    }
+  }
+  DynamicMatrix<int64_t> copy = block.Materialized();
+  assert(MatrixView<const int64_t>(copy) == block);
+
+  // block += its own transpose's transpose, i.e. doubles it in place
+  DynamicMatrix<int64_t> doubled = block * 2;
+  block += transposed.Transposed();
+  assert(MatrixView<const int64_t>(doubled) == block);
+  block.Assign(MatrixView<const int64_t>(copy));
+  assert(matrix(5, 7) == copy(3, 4));
+
+  // a 4 x 5 block times the transpose of another one, through the kernel
+  MatrixView<int64_t> other = view.Block(0, 0, 4, 5);
+  DynamicMatrix<int64_t> expected =
+      NaiveProduct(block.Materialized(), other.Transposed().Materialized());
+  assert(block * other.Transposed() == expected);
+  DynamicMatrix<int64_t> target(4, 4, 1);
+  MultiplyAdd(block, other.Transposed(), MatrixView<int64_t>(target));
+  for (std::size_t i = 0; i < 4; ++i) {
+    for (std::size_t j = 0; j < 4; ++j) {
+      assert(target(i, j) == expected(i, j) + 1);
+    }
+  }
+
+  bool outside = false;
+  try {
+    view.Block(5, 0, 3, 1);
+  } catch (const std::out_of_range&) {
+    outside = true;
+  }
+  bool mismatch = false;
+  try {
+    block += view;
+  } catch (const std::invalid_argument&) {
+    mismatch = true;
+  }
+  assert(outside && mismatch);
+}
+
+// Every layout with fixed strides; AlignedRows pads 9 int64_t to 16.
+void TestMatrixView() {
+  std::mt19937_64 random(44);
+  CheckView<RowMajor>(9, 1, random);
+  CheckView<ColumnMajor>(1, 7, random);
+  CheckView<AlignedRows<>>(16, 1, random);
+}
+
+// Products (the unrolled, the direct and the blocked kernel), mixed-layout
+// products and sums, transposes, traces and element-wise arithmetic of
+// matrices in Layout, each against the naive row-major result.
+template <std::size_t N, std::size_t M, std::size_t K, typename Layout>
+void CheckLayoutProduct(std::mt19937_64& random) {
+  Matrix<N, M, int64_t, Layout> left;
+  Matrix<M, K, int64_t, Layout> right;
+  FillRandom(left, random, 100);
+  FillRandom(right, random, 100);
+  Matrix<N, K> expected = NaiveProduct(left, right);
+  Matrix<N, K, int64_t, Layout> product = left * right;
+  Matrix<M, K> row_major(right);
+  Matrix<N, K, int64_t, Layout> mixed = left * row_major;
+  Matrix<N, K> product_row_major(product);
+  Matrix<N, K> mixed_row_major(mixed);
+  assert(product_row_major == expected && mixed_row_major == expected);
+  Matrix<K, M, int64_t, Layout> transposed = right.Transposed();
+  for (std::size_t i = 0; i < M; ++i) {
+    for (std::size_t j = 0; j < K; ++j) {
+      assert(transposed(j, i) == right(i, j));
+    }
+  }
+}
+
+template <typename Layout>
+void CheckLayout(std::mt19937_64& random) {
+  CheckLayoutProduct<3, 4, 5, Layout>(random);
+  CheckLayoutProduct<13, 17, 11, Layout>(random);
+  CheckLayoutProduct<50, 60, 70, Layout>(random);
+
+  Matrix<21, 21, int64_t, Layout> square;
+  FillRandom(square, random, 100);
+  Matrix<21, 21> reference(square);
+  Matrix<21, 21, int64_t, Layout> in_place = square;
+  in_place.TransposeInPlace();
+  Matrix<21, 21> in_place_row_major(in_place);
+  assert(in_place_row_major == reference.Transposed());
+  assert(square.Trace() == reference.Trace());
+
+  Matrix<21, 21, int64_t, Layout> other;
+  FillRandom(other, random, 100);
+  Matrix<21, 21> other_reference(other);
+  Matrix<21, 21, int64_t, Layout> sum = square;
+  sum += other;
+  sum *= 3;
+  sum -= other;
+  Matrix<21, 21> expected = (reference + other_reference) * 3 - other_reference;
+  Matrix<21, 21> sum_row_major(sum);
+  assert(sum_row_major == expected);
+  assert(sum == square * 3 + other * 2 && sum == expected);
+  assert(!(sum == square));
+}
+
+// Where Storage::Index puts element (i, j), read back through a buffer that
+// holds its own index at every position.
+template <std::size_t N, std::size_t M, typename Layout>
+bool MapsLike(std::size_t (*index)(std::size_t, std::size_t)) {
+  using Type = Matrix<N, M, int64_t, Layout>;
+  typename Type::Buffer buffer;
+  for (std::size_t k = 0; k < buffer.size(); ++k) {
+    buffer[k] = int64_t(k);
+  }
+  Type matrix(std::move(buffer));
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < M; ++j) {
+      if (matrix(i, j) != int64_t(index(i, j))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void TestLayouts() {
+  assert((MapsLike<6, 5, ColumnMajor>(
+      [](std::size_t i, std::size_t j) { return j * 6 + i; })));
+  // 6 x 5 in 4 x 4 tiles: two tile rows of two tiles, 64 elements in all
+  assert((MapsLike<6, 5, Tiled<4>>([](std::size_t i, std::size_t j) {
+    return ((i / 4) * 2 + j / 4) * 16 + (i % 4) * 4 + j % 4;
+  })));
+  assert((Matrix<6, 5, int64_t, Tiled<4>>::Buffer().size() == 64));
+
+  std::mt19937_64 random(45);
+  CheckLayout<RowMajor>(random);
+  CheckLayout<ColumnMajor>(random);
+  CheckLayout<Tiled<>>(random);
+  CheckLayout<Tiled<4>>(random);
+}
+
+// Every row of an AlignedRows matrix starts on the alignment boundary,
+// whether the matrix lives on the stack or the heap, and the padding past
+// column M never shows in a comparison.
+void TestAlignedRows() {
+  using Padded = Matrix<9, 9, int64_t, AlignedRows<>>;
+  assert((AlignedRows<>::Storage<9, 9, int64_t>::kRowStride == 16));
+  assert((MapsLike<9, 9, AlignedRows<>>(
+      [](std::size_t i, std::size_t j) { return i * 16 + j; })));
+
+  Padded on_stack;
+  auto on_heap = std::make_unique<Padded>();
+  for (std::size_t i = 0; i < 9; ++i) {
+    assert(reinterpret_cast<std::uintptr_t>(&on_stack(i, 0)) % 64 == 0);
+    assert(reinterpret_cast<std::uintptr_t>(&(*on_heap)(i, 0)) % 64 == 0);
+  }
+
+  Padded::Buffer zero_padded{};
+  Padded::Buffer junk_padded;
+  junk_padded.fill(-1);
+  for (std::size_t i = 0; i < 9; ++i) {
+    for (std::size_t j = 0; j < 9; ++j) {
+      zero_padded[i * 16 + j] = junk_padded[i * 16 + j] = int64_t(i * 9 + j);
+    }
+  }
+  Padded zero(std::move(zero_padded));
+  Padded junk(std::move(junk_padded));
+  assert(zero == junk);
+  junk(8, 8) = 0;
+  assert(!(zero == junk));
+
+  std::mt19937_64 random(46);
+  CheckLayout<AlignedRows<>>(random);
+  CheckLayout<AlignedRows<32>>(random);
+}
+
+// Products small enough for the unrolled kernel, up to the largest volume
+// it takes and the first one past it, against the naive loops. The entries
+// are small integers, so even the double products are exact.
+template <std::size_t N, std::size_t M, std::size_t K, typename T>
+void CheckSmallProduct(std::mt19937_64& random) {
+  Matrix<N, M, T> left;
+  Matrix<M, K, T> right;
+  FillRandom(left, random, 1000);
+  FillRandom(right, random, 1000);
+  Matrix<N, K, T> product = left * right;
+  assert(product == NaiveProduct(left, right));
+}
+
+// matrix b of a batch product is the product of matrices b, for batch
+// sizes on both sides of a cache line of lanes
+template <std::size_t N, std::size_t M, std::size_t K>
+void CheckBatchProduct(std::size_t size, ThreadPool& pool,
+                       std::mt19937_64& random) {
+  MatrixBatch<N, M> left(size);
+  MatrixBatch<M, K> right(size);
+  std::vector<Matrix<N, M>> lefts(size);
+  std::vector<Matrix<M, K>> rights(size);
+  for (std::size_t b = 0; b < size; ++b) {
+    FillRandom(lefts[b], random, 1000);
+    FillRandom(rights[b], random, 1000);
+    left.Set(b, lefts[b]);
+    right.Set(b, rights[b]);
+  }
+  MatrixBatch<N, K> product = left * right;
+  MatrixBatch<N, K> parallel = Multiply(left, right, pool);
+  MatrixBatch<N, K> reused(size);
+  Multiply(left, right, reused);
+  for (std::size_t b = 0; b < size; ++b) {
+    Matrix<N, K> expected = NaiveProduct(lefts[b], rights[b]);
+    assert(left.Get(b) == lefts[b]);
+    assert(product.Get(b) == expected);
+    assert(parallel.Get(b) == expected);
+    assert(reused.Get(b) == expected);
+  }
+}
+
+void TestSmallProducts() {
+  std::mt19937_64 random(48);
+  CheckSmallProduct<1, 1, 1, int64_t>(random);
+  CheckSmallProduct<2, 3, 4, int64_t>(random);
+  CheckSmallProduct<7, 1, 9, int64_t>(random);
+  CheckSmallProduct<3, 8, 5, double>(random);
+  CheckSmallProduct<8, 8, 8, int64_t>(random);
+  CheckSmallProduct<8, 8, 9, int64_t>(random);
+  CheckSmallProduct<1, 64, 1, double>(random);
+
+  ThreadPool pool(3);
+  for (std::size_t size : {1, 7, 8, 9, 37, 100}) {
+    CheckBatchProduct<3, 4, 5>(size, pool, random);
+    CheckBatchProduct<4, 4, 4>(size, pool, random);
+  }
+  CheckBatchProduct<1, 1, 1>(1000, pool, random);
+
+  MatrixBatch<2, 2> two(2);
+  MatrixBatch<2, 2> three(3);
+  bool threw = false;
+  try {
+    two * three;
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+  threw = false;
+  try {
+    Multiply(two, two, three);
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+// A tropical product spelled out: a missing edge (infinity) on either side
+// of a term drops the term, and an element with no terms left is infinity.
+template <bool Minimize, std::size_t N, std::size_t M, std::size_t K,
+          typename T>
+Matrix<N, K, T> NaiveTropicalProduct(const Matrix<N, M, T>& left,
+                                     const Matrix<M, K, T>& right,
+                                     T infinity) {
+  Matrix<N, K, T> result(infinity);
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < K; ++j) {
+      for (std::size_t k = 0; k < M; ++k) {
+        if (left(i, k) == infinity || right(k, j) == infinity) {
+          continue;
+        }
+        T term = left(i, k) + right(k, j);
+        if (result(i, j) == infinity ||
+            (Minimize ? term < result(i, j) : term > result(i, j))) {
+          result(i, j) = term;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+// Entries in [-1000, 1000], with about one in four of them infinity, so
+// that sums of two infinities (which would overflow integer T) and of
+// infinity and a negative entry both occur.
+template <typename Semiring, bool Minimize, std::size_t N, std::size_t M,
+          std::size_t K, typename T>
+void CheckTropical(ThreadPool& pool, std::mt19937_64& random) {
+  T infinity = Semiring::template Zero<T>();
+  Matrix<N, M, T> left;
+  Matrix<M, K, T> right;
+  FillRandom(left, random, 1000);
+  FillRandom(right, random, 1000);
+  for (std::size_t k = 0; k < M; ++k) {
+    for (std::size_t i = 0; i < N; ++i) {
+      left(i, k) = random() % 4 == 0 ? infinity : left(i, k);
+    }
+    for (std::size_t j = 0; j < K; ++j) {
+      right(k, j) = random() % 4 == 0 ? infinity : right(k, j);
+    }
+  }
+  for (std::size_t j = 0; j < K; ++j) {
+    right(0, j) = infinity;
+  }
+  Matrix<N, K, T> expected =
+      NaiveTropicalProduct<Minimize>(left, right, infinity);
+  Matrix<N, K, T> product = Multiply<Semiring>(left, right);
+  Matrix<N, K, T> parallel = Multiply<Semiring>(left, right, pool);
+  assert(product == expected && parallel == expected);
+}
+
+// Entries are 0 or nonzero (not only 1); sizes straddle 64-bit words.
+template <std::size_t N, std::size_t M, std::size_t K>
+void CheckOrAnd(ThreadPool& pool, std::mt19937_64& random) {
+  Matrix<N, M, int64_t> left;
+  Matrix<M, K, int64_t> right;
+  for (std::size_t k = 0; k < M; ++k) {
+    for (std::size_t i = 0; i < N; ++i) {
+      left(i, k) = random() % 8 == 0 ? int64_t(random() % 5) - 2 : 0;
+    }
+    for (std::size_t j = 0; j < K; ++j) {
+      right(k, j) = random() % 8 == 0 ? int64_t(random() % 5) - 2 : 0;
+    }
+  }
+  Matrix<N, K, int64_t> expected;
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t j = 0; j < K; ++j) {
+      for (std::size_t k = 0; k < M; ++k) {
+        if (left(i, k) != 0 && right(k, j) != 0) {
+          expected(i, j) = 1;
+        }
+      }
+    }
+  }
+  Matrix<N, K, int64_t> product = Multiply<OrAnd>(left, right);
+  Matrix<N, K, int64_t> parallel = Multiply<OrAnd>(left, right, pool);
+  assert(product == expected && parallel == expected);
+}
+
+void TestSemirings() {
+  std::mt19937_64 random(50);
+  ThreadPool pool(3);
+  CheckTropical<MinPlus, true, 9, 9, 9, int64_t>(pool, random);
+  CheckTropical<MinPlus, true, 60, 70, 50, int64_t>(pool, random);
+  CheckTropical<MinPlus, true, 60, 70, 50, double>(pool, random);
+  CheckTropical<MaxPlus, false, 9, 9, 9, int64_t>(pool, random);
+  CheckTropical<MaxPlus, false, 60, 70, 50, int64_t>(pool, random);
+  CheckTropical<MaxPlus, false, 60, 70, 50, double>(pool, random);
+  CheckTropical<MinPlus, true, 40, 40, 40, int32_t>(pool, random);
+
+  // a path through the largest finite weight still must not wrap around
+  int64_t large = std::numeric_limits<int64_t>::max() / 2 - 1;
+  Matrix<2, 2, int64_t> path(MinPlus::Zero<int64_t>());
+  path(0, 0) = path(1, 1) = large;
+  Matrix<2, 2, int64_t> squared = Multiply<MinPlus>(path, path);
+  assert(squared(0, 0) == 2 * large);
+  assert(squared(0, 1) == MinPlus::Zero<int64_t>());
+
+  CheckOrAnd<5, 7, 3>(pool, random);
+  CheckOrAnd<64, 64, 64>(pool, random);
+  CheckOrAnd<65, 130, 70>(pool, random);
+  CheckOrAnd<200, 129, 191>(pool, random);
+}
+
+// Strassen-Winograd products of odd sizes, where every level peels off a
+// row and a column, with cutoffs small enough for several levels.
+template <std::size_t N, typename Layout>
+void CheckStrassen(std::mt19937_64& random) {
+  Matrix<N, N, int64_t, Layout> left;
+  Matrix<N, N, int64_t, Layout> right;
+  FillRandom(left, random, 1000);
+  FillRandom(right, random, 1000);
+  Matrix<N, N, int64_t, Layout> expected = left * right;
+  for (std::size_t cutoff : {1, 2, 5, 16}) {
+    Matrix<N, N, int64_t, Layout> product =
+        StrassenMultiply(left, right, cutoff);
+    assert(product == expected);
+  }
+
+  Matrix<N, N, double> left_real;
+  Matrix<N, N, double> right_real;
+  FillRandom(left_real, random, 10);
+  FillRandom(right_real, random, 10);
+  Matrix<N, N, double> product_real =
+      StrassenMultiply(left_real, right_real, 4);
+  assert(MaxDifference(product_real, NaiveProduct(left_real, right_real)) <
+         1e-9);
+}
+
+void TestStrassen() {
+  std::mt19937_64 random(37);
+  CheckStrassen<1, RowMajor>(random);
+  CheckStrassen<3, RowMajor>(random);
+  CheckStrassen<33, RowMajor>(random);
+  CheckStrassen<65, RowMajor>(random);
+  CheckStrassen<101, ColumnMajor>(random);
+  CheckStrassen<64, Tiled<>>(random);
+
+  for (std::size_t size : {1, 7, 31, 97}) {
+    DynamicMatrix<int64_t> left(size, size);
+    DynamicMatrix<int64_t> right(size, size);
+    for (std::size_t i = 0; i < size; ++i) {
+      for (std::size_t j = 0; j < size; ++j) {
+        left(i, j) = int64_t(random() % 2001) - 1000;
+        right(i, j) = int64_t(random() % 2001) - 1000;
+      }
+    }
+    assert(StrassenMultiply(left, right, 3) == NaiveProduct(left, right));
+  }
+  bool threw = false;
+  try {
+    DynamicMatrix<int64_t> wide(2, 3);
+    DynamicMatrix<int64_t> tall(3, 2);
+    StrassenMultiply(wide, tall);
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+// The parallel CSC product sums each thread's columns separately; it must
+// match the serial one for any thread count, including more threads than
+// columns.
+void TestParallelCscVector() {
+  std::vector<SparseMatrix<int64_t>::Triplet> triplets;
+  for (std::size_t k = 0; k < 500; ++k) {
+    triplets.push_back({k * 7 % 97, k * 13 % 41, int64_t(k % 11) - 5});
+  }
+  SparseMatrix<int64_t> csc(97, 41, triplets,
+                            SparseMatrix<int64_t>::Format::kCsc);
+  std::vector<int64_t> vector(41);
+  for (std::size_t j = 0; j < vector.size(); ++j) {
+    vector[j] = int64_t(j) - 20;
+  }
+  std::vector<int64_t> expected = csc * vector;
+  for (std::size_t threads : {1, 3, 8, 64}) {
+    ThreadPool pool(threads);
+    assert(Multiply(csc, vector, pool) == expected);
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestPoolStress();
+  TestExpressionsAreLazy();
+  TestExpressionOperands();
+  TestBigIntDeterminant();
+  TestLinearSystems();
+  TestOrthogonalAndCholesky();
+  TestPowers();
+  TestParallelCscVector();
+  TestSparseMatrix();
+  TestMatrixView();
+  TestLayouts();
+  TestAlignedRows();
+  TestSmallProducts();
+  TestSemirings();
+  TestStrassen();
+  std::puts("all tests passed");
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+#include "dynamic_matrix.hpp"
+#include "kernels.hpp"
+#include "matrix.hpp"
+
+// Non-owning window onto elements of a Matrix, a DynamicMatrix or any
+// buffer: element (i, j) lives at data[i * row_stride + j * column_stride].
+// Blocks and transposes are views again, so nothing is copied until
+// Materialized(). MatrixView<const T> is the read-only flavour; a view must
+// not outlive the storage it points into. Shape mismatches throw
+// std::invalid_argument, blocks outside the view std::out_of_range.
+template <typename T>
+class MatrixView {
+  using Value = std::remove_const_t<T>;
+
+ public:
+  MatrixView(T* data, std::size_t rows, std::size_t columns,
+             std::size_t row_stride, std::size_t column_stride = 1)
+      : data_(data),
+        rows_(rows),
+        columns_(columns),
+        row_stride_(row_stride),
+        column_stride_(column_stride) {}
+
+  // Matrices whose layout has fixed strides, i.e. not Tiled ones; the row
+  // stride of AlignedRows includes the padding.
+  template <std::size_t N, std::size_t M, typename Layout>
+    requires requires { Layout::template Storage<N, M, Value>::kRowStride; }
+  MatrixView(Matrix<N, M, Value, Layout>& matrix)
+      : MatrixView(&matrix(0, 0), N, M,
+                   Layout::template Storage<N, M, Value>::kRowStride,
+                   Layout::template Storage<N, M, Value>::kColumnStride) {}
+
+  template <std::size_t N, std::size_t M, typename Layout>
+    requires std::is_const_v<T> &&
+             requires { Layout::template Storage<N, M, Value>::kRowStride; }
+  MatrixView(const Matrix<N, M, Value, Layout>& matrix)
+      : MatrixView(&matrix(0, 0), N, M,
+                   Layout::template Storage<N, M, Value>::kRowStride,
+                   Layout::template Storage<N, M, Value>::kColumnStride) {}
+
+  MatrixView(DynamicMatrix<Value>& matrix)
+      : MatrixView(matrix.Data(), matrix.Rows(), matrix.Columns(),
+                   matrix.Columns()) {}
+
+  MatrixView(const DynamicMatrix<Value>& matrix)
+    requires std::is_const_v<T>
+      : MatrixView(matrix.Data(), matrix.Rows(), matrix.Columns(),
+                   matrix.Columns()) {}
+
+  // a read-only view of the same elements
+  operator MatrixView<const Value>() const {
+    return {data_, rows_, columns_, row_stride_, column_stride_};
+  }
+
+  std::size_t Rows() const { return rows_; }
+  std::size_t Columns() const { return columns_; }
+  std::size_t RowStride() const { return row_stride_; }
+  std::size_t ColumnStride() const { return column_stride_; }
+
+  MatrixView Block(std::size_t row, std::size_t column, std::size_t rows,
+                   std::size_t columns) const {
+    if (row + rows > rows_ || column + columns > columns_) {
+      throw std::out_of_range("MatrixView: block outside the view");
+    }
+    return {data_ + row * row_stride_ + column * column_stride_, rows, columns,
+            row_stride_, column_stride_};
+  }
+
+  MatrixView Row(std::size_t row) const { return Block(row, 0, 1, columns_); }
+  MatrixView Column(std::size_t column) const {
+    return Block(0, column, rows_, 1);
+  }
+
+  MatrixView Transposed() const {
+    return {data_, columns_, rows_, column_stride_, row_stride_};
+  }
+
+  DynamicMatrix<Value> Materialized() const {
+    DynamicMatrix<Value> result(rows_, columns_);
+    MatrixView<Value>(result).Assign(*this);
+    return result;
+  }
+
+  T& operator()(std::size_t row, std::size_t column) const {
+    return data_[row * row_stride_ + column * column_stride_];
+  }
+
+  // Element-wise copy from a view of the same shape. Here and in the
+  // arithmetic below, rows that are contiguous in both views go through the
+  // same kernels as Matrix.
+  template <typename U>
+  const MatrixView& Assign(const MatrixView<U>& other) const {
+    CheckSameShape(other);
+    for (std::size_t i = 0; i < rows_; ++i) {
+      if (column_stride_ == 1 && other.ColumnStride() == 1) {
+        std::copy(&other(i, 0), &other(i, 0) + columns_, &(*this)(i, 0));
+        continue;
+      }
+      for (std::size_t j = 0; j < columns_; ++j) {
+        (*this)(i, j) = other(i, j);
+      }
+    }
+    return *this;
+  }
+
+  template <typename U>
+  const MatrixView& operator+=(const MatrixView<U>& other) const {
+    CheckSameShape(other);
+    for (std::size_t i = 0; i < rows_; ++i) {
+      if (column_stride_ == 1 && other.ColumnStride() == 1) {
+        utils::AddTo(&(*this)(i, 0), &other(i, 0), columns_);
+        continue;
+      }
+      for (std::size_t j = 0; j < columns_; ++j) {
+        (*this)(i, j) += other(i, j);
+      }
+    }
+    return *this;
+  }
+
+  template <typename U>
+  const MatrixView& operator-=(const MatrixView<U>& other) const {
+    CheckSameShape(other);
+    for (std::size_t i = 0; i < rows_; ++i) {
+      if (column_stride_ == 1 && other.ColumnStride() == 1) {
+        utils::SubtractFrom(&(*this)(i, 0), &other(i, 0), columns_);
+        continue;
+      }
+      for (std::size_t j = 0; j < columns_; ++j) {
+        (*this)(i, j) -= other(i, j);
+      }
+    }
+    return *this;
+  }
+
+  const MatrixView& operator*=(const Value& other) const {
+    for (std::size_t i = 0; i < rows_; ++i) {
+      if (column_stride_ == 1) {
+        utils::ScaleBy(&(*this)(i, 0), other, columns_);
+        continue;
+      }
+      for (std::size_t j = 0; j < columns_; ++j) {
+        (*this)(i, j) *= other;
+      }
+    }
+    return *this;
+  }
+
+  // Fresh matrices for the out-of-place operations, as with DynamicMatrix.
+  template <typename U>
+  DynamicMatrix<Value> operator+(const MatrixView<U>& other) const {
+    DynamicMatrix<Value> result = Materialized();
+    MatrixView<Value>(result) += other;
+    return result;
+  }
+
+  template <typename U>
+  DynamicMatrix<Value> operator-(const MatrixView<U>& other) const {
+    DynamicMatrix<Value> result = Materialized();
+    MatrixView<Value>(result) -= other;
+    return result;
+  }
+
+  DynamicMatrix<Value> operator*(const Value& other) const {
+    DynamicMatrix<Value> result = Materialized();
+    MatrixView<Value>(result) *= other;
+    return result;
+  }
+
+  template <typename U>
+  DynamicMatrix<Value> operator*(const MatrixView<U>& other) const {
+    DynamicMatrix<Value> result(rows_, other.Columns());
+    MultiplyAdd(*this, other, MatrixView<Value>(result));
+    return result;
+  }
+
+  template <typename U>
+  bool operator==(const MatrixView<U>& other) const {
+    if (rows_ != other.Rows() || columns_ != other.Columns()) {
+      return false;
+    }
+    for (std::size_t i = 0; i < rows_; ++i) {
+      for (std::size_t j = 0; j < columns_; ++j) {
+        if ((*this)(i, j) != other(i, j)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+ private:
+  template <typename U>
+  void CheckSameShape(const MatrixView<U>& other) const {
+    if (rows_ != other.Rows() || columns_ != other.Columns()) {
+      throw std::invalid_argument("MatrixView: shapes differ");
+    }
+  }
+
+  T* data_;
+  std::size_t rows_;
+  std::size_t columns_;
+  std::size_t row_stride_;
+  std::size_t column_stride_;
+};
+
+// result += left * right in place, through the blocked kernel; the building
+// block for block algorithms that update a slice of a larger matrix.
+template <typename Left, typename Right, typename Result>
+void MultiplyAdd(const MatrixView<Left>& left, const MatrixView<Right>& right,
+                 const MatrixView<Result>& result) {
+  if (left.Columns() != right.Rows() || result.Rows() != left.Rows() ||
+      result.Columns() != right.Columns()) {
+    throw std::invalid_argument("MatrixView: inner dimensions differ");
+  }
+  MatrixView<Result> target = result;
+  utils::Multiply(left, right, target, left.Rows(), left.Columns(),
+                  right.Columns());
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <limits>
+#include <type_traits>
+
+// Semirings for Multiply<Semiring>: element (i, j) of a product is the sum
+// over k of the products left(i, k) * right(k, j), with sum and product
+// being those of the semiring. A semiring gives Zero<T>(), the identity of
+// its sum that any product with it turns back into Zero, and updates an
+// accumulator in place: Add(acc, value) sets acc = acc + value, and
+// MultiplyAdd(acc, a, b) sets acc = acc + a * b. Both take GCC vectors as
+// well as scalars (a vector accumulator with a scalar a), so the SIMD
+// kernels run any semiring whose operations have a vector form; vectors are
+// never returned by value, as in simd.hpp.
+
+namespace utils {
+// a + b for integer T, or Semiring::Zero<T>() if either of them is: the sum
+// wraps around instead of overflowing and the choice is a select, not a
+// branch, so kernel loops over it still vectorize.
+template <typename Semiring, typename T>
+T SaturatedSum(const T& a, const T& b) {
+  using Unsigned = std::make_unsigned_t<T>;
+  T sum = static_cast<T>(static_cast<Unsigned>(a) + static_cast<Unsigned>(b));
+  bool finite = (a != Semiring::template Zero<T>()) &
+                (b != Semiring::template Zero<T>());
+  return finite ? sum : Semiring::template Zero<T>();
+}
+}  // namespace utils
+
+// Ordinary arithmetic, what operator* computes.
+struct PlusTimes {
+  template <typename T>
+  static T Zero() {
+    return T();
+  }
+
+  template <typename A>
+  static void Add(A& acc, const A& value) {
+    acc += value;
+  }
+
+  template <typename A, typename B, typename C>
+  static void MultiplyAdd(A& acc, const B& a, const C& b) {
+    acc += a * b;
+  }
+};
+
+// Tropical (min, +): shortest paths, with Zero<T>() meaning no path. That
+// is +infinity for floating-point T and the largest value for integer T,
+// where sums with it stay at it instead of overflowing.
+struct MinPlus {
+  template <typename T>
+  static T Zero() {
+    return std::numeric_limits<T>::has_infinity
+               ? std::numeric_limits<T>::infinity()
+               : std::numeric_limits<T>::max();
+  }
+
+  template <typename A>
+  static void Add(A& acc, const A& value) {
+    acc = value < acc ? value : acc;
+  }
+
+  template <typename T>
+    requires std::is_integral_v<T>
+  static void MultiplyAdd(T& acc, const T& a, const T& b) {
+    Add(acc, utils::SaturatedSum<MinPlus>(a, b));
+  }
+
+  template <typename A, typename B, typename C>
+  static void MultiplyAdd(A& acc, const B& a, const C& b) {
+    Add(acc, a + b);
+  }
+};
+
+// Tropical (max, +): longest or critical paths, the mirror image of MinPlus
+// with -infinity (the lowest value for integer T) meaning no path.
+struct MaxPlus {
+  template <typename T>
+  static T Zero() {
+    return std::numeric_limits<T>::has_infinity
+               ? -std::numeric_limits<T>::infinity()
+               : std::numeric_limits<T>::lowest();
+  }
+
+  template <typename A>
+  static void Add(A& acc, const A& value) {
+    acc = value > acc ? value : acc;
+  }
+
+  template <typename T>
+    requires std::is_integral_v<T>
+  static void MultiplyAdd(T& acc, const T& a, const T& b) {
+    Add(acc, utils::SaturatedSum<MaxPlus>(a, b));
+  }
+
+  template <typename A, typename B, typename C>
+  static void MultiplyAdd(A& acc, const B& a, const C& b) {
+    Add(acc, a + b);
+  }
+};
+
+// Boolean (or, and): reachability. Any element other than T() counts as
+// true and results are T(1) or T(); products go through bit-packed rows
+// rather than through these scalar forms.
+struct OrAnd {
+  template <typename T>
+  static T Zero() {
+    return T();
+  }
+
+  template <typename T>
+  static void Add(T& acc, const T& value) {
+    acc = static_cast<T>(acc != T() || value != T());
+  }
+
+  template <typename T>
+  static void MultiplyAdd(T& acc, const T& a, const T& b) {
+    acc = static_cast<T>(acc != T() || (a != T() && b != T()));
+  }
+};
@@ -0,0 +1,500 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+// Kernels for float, double and int64_t written once over GCC vector
+// extensions and compiled three times: for AVX-512, for AVX2 and for the
+// baseline target. The widest one the CPU supports is picked at run time.
+// They need GCC itself (__builtin_shuffle, target attributes, CPU probing)
+// on x86; for other compilers and targets this header defines nothing and
+// MATRIX_SIMD stays undefined, so kernels.hpp keeps its generic loops.
+#if defined(__GNUC__) && !defined(__clang__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_SIMD
+
+namespace utils::simd {
+
+enum class Isa { kBaseline, kAvx2, kAvx512 };
+
+inline Isa DetectIsa() {
+  static const Isa kIsa = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512dq")) {
+      return Isa::kAvx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return Isa::kAvx2;
+    }
+    return Isa::kBaseline;
+  }();
+  return kIsa;
+}
+
+template <typename T, std::size_t Bytes>
+struct Vector;
+
+template <std::size_t Bytes>
+struct Vector<float, Bytes> {
+  typedef float Type __attribute__((vector_size(Bytes)));
+  typedef int32_t Mask __attribute__((vector_size(Bytes)));
+};
+
+template <std::size_t Bytes>
+struct Vector<double, Bytes> {
+  typedef double Type __attribute__((vector_size(Bytes)));
+  typedef int64_t Mask __attribute__((vector_size(Bytes)));
+};
+
+template <std::size_t Bytes>
+struct Vector<int64_t, Bytes> {
+  typedef int64_t Type __attribute__((vector_size(Bytes)));
+  typedef int64_t Mask __attribute__((vector_size(Bytes)));
+};
+
+template <typename T, std::size_t Bytes>
+using VectorType = typename Vector<T, Bytes>::Type;
+
+// Vectors are only passed by reference: by value their ABI would depend on
+// the target of the caller.
+template <typename T, std::size_t Bytes>
+[[gnu::always_inline]] inline void Load(VectorType<T, Bytes>& value,
+                                        const T* ptr) {
+  std::memcpy(&value, ptr, Bytes);
+}
+
+template <typename T, std::size_t Bytes>
+[[gnu::always_inline]] inline void Store(T* ptr,
+                                         const VectorType<T, Bytes>& value) {
+  std::memcpy(ptr, &value, Bytes);
+}
+
+template <typename T, std::size_t Bytes>
+[[gnu::always_inline]] inline void AddBody(T* dst, const T* src,
+                                           std::size_t count) {
+  const std::size_t kLanes = Bytes / sizeof(T);
+  const std::size_t vectorized = count - count % kLanes;
+  std::size_t i = 0;
+  VectorType<T, Bytes> lhs;
+  VectorType<T, Bytes> rhs;
+  for (; i < vectorized; i += kLanes) {
+    Load<T, Bytes>(lhs, dst + i);
+    Load<T, Bytes>(rhs, src + i);
+    lhs += rhs;
+    Store<T, Bytes>(dst + i, lhs);
+  }
+  for (; i < count; ++i) {
+    dst[i] += src[i];
+  }
+}
+
+template <typename T, std::size_t Bytes>
+[[gnu::always_inline]] inline void SubtractBody(T* dst, const T* src,
+                                                std::size_t count) {
+  const std::size_t kLanes = Bytes / sizeof(T);
+  const std::size_t vectorized = count - count % kLanes;
+  std::size_t i = 0;
+  VectorType<T, Bytes> lhs;
+  VectorType<T, Bytes> rhs;
+  for (; i < vectorized; i += kLanes) {
+    Load<T, Bytes>(lhs, dst + i);
+    Load<T, Bytes>(rhs, src + i);
+    lhs -= rhs;
+    Store<T, Bytes>(dst + i, lhs);
+  }
+  for (; i < count; ++i) {
+    dst[i] -= src[i];
+  }
+}
+
+template <typename T, std::size_t Bytes>
+[[gnu::always_inline]] inline void ScaleBody(T* dst, T factor,
+                                             std::size_t count) {
+  const std::size_t kLanes = Bytes / sizeof(T);
+  const std::size_t vectorized = count - count % kLanes;
+  std::size_t i = 0;
+  VectorType<T, Bytes> lhs;
+  for (; i < vectorized; i += kLanes) {
+    Load<T, Bytes>(lhs, dst + i);
+    lhs *= factor;
+    Store<T, Bytes>(dst + i, lhs);
+  }
+  for (; i < count; ++i) {
+    dst[i] *= factor;
+  }
+}
+
+// result = row Row of left times column Column of right, for one vector of
+// lanes.
+template <typename T, std::size_t Bytes, std::size_t Row, std::size_t Column,
+          std::size_t Inner, std::size_t Columns, std::size_t... Depth>
+[[gnu::always_inline]] inline void BatchDot(
+    T* result, const VectorType<T, Bytes>* left,
+    const VectorType<T, Bytes>* right, std::index_sequence<Depth...> /*k*/) {
+  VectorType<T, Bytes> sum =
+      (... + (left[Row * Inner + Depth] * right[Depth * Columns + Column]));
+  Store<T, Bytes>(result, sum);
+}
+
+// One vector of lanes of a batched product. The index packs spell out every
+// load, multiply-add and store at compile time, so the operands stay in
+// registers instead of in arrays indexed by loop counters.
+template <typename T, std::size_t Bytes, std::size_t Inner,
+          std::size_t Columns, std::size_t... Left, std::size_t... Right,
+          std::size_t... Result>
+[[gnu::always_inline]] inline void BatchStep(
+    const T* left, const T* right, T* result, std::size_t stride,
+    std::index_sequence<Left...> /*left*/,
+    std::index_sequence<Right...> /*right*/,
+    std::index_sequence<Result...> /*result*/) {
+  VectorType<T, Bytes> lhs[sizeof...(Left)];
+  VectorType<T, Bytes> rhs[sizeof...(Right)];
+  (Load<T, Bytes>(lhs[Left], left + Left * stride), ...);
+  (Load<T, Bytes>(rhs[Right], right + Right * stride), ...);
+  (BatchDot<T, Bytes, Result / Columns, Result % Columns, Inner, Columns>(
+       result + Result * stride, lhs, rhs, std::make_index_sequence<Inner>()),
+   ...);
+}
+
+// Lanes [begin, end) of a batch of Rows x Inner times Inner x Columns
+// products stored element-major: the lanes of element e of every left
+// matrix start at left + e * stride, elements numbered row by row, likewise
+// right and result. One vector of lanes is finished for the whole result
+// before the next one is loaded, so each operand is read once.
+template <typename T, std::size_t Bytes, std::size_t Rows, std::size_t Inner,
+          std::size_t Columns>
+[[gnu::always_inline]] inline void MultiplyBatchBody(
+    const T* left, const T* right, T* result, std::size_t stride,
+    std::size_t begin, std::size_t end) {
+  const std::size_t kLanes = Bytes / sizeof(T);
+  std::size_t lane = begin;
+  for (; lane + kLanes <= end; lane += kLanes) {
+    BatchStep<T, Bytes, Inner, Columns>(
+        left + lane, right + lane, result + lane, stride,
+        std::make_index_sequence<Rows * Inner>(),
+        std::make_index_sequence<Inner * Columns>(),
+        std::make_index_sequence<Rows * Columns>());
+  }
+  for (; lane < end; ++lane) {
+    for (std::size_t i = 0; i < Rows; ++i) {
+      for (std::size_t j = 0; j < Columns; ++j) {
+        T sum = T();
+        for (std::size_t k = 0; k < Inner; ++k) {
+          sum += left[(i * Inner + k) * stride + lane] *
+                 right[(k * Columns + j) * stride + lane];
+        }
+        result[(i * Columns + j) * stride + lane] = sum;
+      }
+    }
+  }
+}
+
+// acc[Rows][Columns] += left panel * right panel in Semiring (see
+// semiring.hpp), where every row of the right panel is Columns elements wide
+// and held in Columns / kLanes vectors.
+template <typename Semiring, typename T, std::size_t Bytes, std::size_t Rows,
+          std::size_t Columns>
+[[gnu::always_inline]] inline void MicroKernelBody(const T* left,
+                                                   const T* right,
+                                                   std::size_t depth, T* acc) {
+  const std::size_t kLanes = Bytes / sizeof(T);
+  const std::size_t kVectors = Columns / kLanes;
+  VectorType<T, Bytes> sum[Rows][kVectors];
+  for (std::size_t i = 0; i < Rows; ++i) {
+    for (std::size_t v = 0; v < kVectors; ++v) {
+      sum[i][v] = VectorType<T, Bytes>{} + Semiring::template Zero<T>();
+    }
+  }
+  for (std::size_t k = 0; k < depth; ++k) {
+    VectorType<T, Bytes> row[kVectors];
+    for (std::size_t v = 0; v < kVectors; ++v) {
+      Load<T, Bytes>(row[v], right + v * kLanes);
+    }
+    for (std::size_t i = 0; i < Rows; ++i) {
+      for (std::size_t v = 0; v < kVectors; ++v) {
+        Semiring::MultiplyAdd(sum[i][v], left[i], row[v]);
+      }
+    }
+    left += Rows;
+    right += Columns;
+  }
+  for (std::size_t i = 0; i < Rows; ++i) {
+    for (std::size_t v = 0; v < kVectors; ++v) {
+      T* dst = acc + i * Columns + v * kLanes;
+      VectorType<T, Bytes> prev;
+      Load<T, Bytes>(prev, dst);
+      Semiring::Add(prev, sum[i][v]);
+      Store<T, Bytes>(dst, prev);
+    }
+  }
+}
+
+// 4 x 4 transpose of 64-bit elements in two rounds of lane shuffles.
+template <typename T>
+[[gnu::always_inline]] inline void TransposeTile64(const T* const* src,
+                                                   T* const* dst) {
+  using Mask = typename Vector<T, 32>::Mask;
+  const Mask kLowPairs = {0, 4, 2, 6};
+  const Mask kHighPairs = {1, 5, 3, 7};
+  const Mask kLowHalves = {0, 1, 4, 5};
+  const Mask kHighHalves = {2, 3, 6, 7};
+
+  VectorType<T, 32> rows[4];
+  for (std::size_t i = 0; i < 4; ++i) {
+    Load<T, 32>(rows[i], src[i]);
+  }
+  VectorType<T, 32> pairs[4];
+  for (std::size_t i = 0; i < 4; i += 2) {
+    pairs[i] = __builtin_shuffle(rows[i], rows[i + 1], kLowPairs);
+    pairs[i + 1] = __builtin_shuffle(rows[i], rows[i + 1], kHighPairs);
+  }
+  for (std::size_t i = 0; i < 2; ++i) {
+    Store<T, 32>(dst[i], __builtin_shuffle(pairs[i], pairs[i + 2], kLowHalves));
+    Store<T, 32>(dst[i + 2],
+                 __builtin_shuffle(pairs[i], pairs[i + 2], kHighHalves));
+  }
+}
+
+// 8 x 8 transpose of 32-bit elements in three rounds of lane shuffles.
+template <typename T>
+[[gnu::always_inline]] inline void TransposeTile32(const T* const* src,
+                                                   T* const* dst) {
+  using Mask = typename Vector<T, 32>::Mask;
+  const Mask kLowPairs = {0, 8, 1, 9, 4, 12, 5, 13};
+  const Mask kHighPairs = {2, 10, 3, 11, 6, 14, 7, 15};
+  const Mask kLowQuads = {0, 1, 8, 9, 4, 5, 12, 13};
+  const Mask kHighQuads = {2, 3, 10, 11, 6, 7, 14, 15};
+  const Mask kLowHalves = {0, 1, 2, 3, 8, 9, 10, 11};
+  const Mask kHighHalves = {4, 5, 6, 7, 12, 13, 14, 15};
+
+  VectorType<T, 32> rows[8];
+  for (std::size_t i = 0; i < 8; ++i) {
+    Load<T, 32>(rows[i], src[i]);
+  }
+  VectorType<T, 32> pairs[8];
+  for (std::size_t i = 0; i < 8; i += 2) {
+    pairs[i] = __builtin_shuffle(rows[i], rows[i + 1], kLowPairs);
+    pairs[i + 1] = __builtin_shuffle(rows[i], rows[i + 1], kHighPairs);
+  }
+  VectorType<T, 32> quads[8];
+  for (std::size_t i = 0; i < 8; i += 4) {
+    quads[i] = __builtin_shuffle(pairs[i], pairs[i + 2], kLowQuads);
+    quads[i + 1] = __builtin_shuffle(pairs[i], pairs[i + 2], kHighQuads);
+    quads[i + 2] = __builtin_shuffle(pairs[i + 1], pairs[i + 3], kLowQuads);
+    quads[i + 3] = __builtin_shuffle(pairs[i + 1], pairs[i + 3], kHighQuads);
+  }
+  for (std::size_t i = 0; i < 4; ++i) {
+    Store<T, 32>(dst[i], __builtin_shuffle(quads[i], quads[i + 4], kLowHalves));
+    Store<T, 32>(dst[i + 4],
+                 __builtin_shuffle(quads[i], quads[i + 4], kHighHalves));
+  }
+}
+
+[[gnu::always_inline]] inline void TransposeTileBody(const float* const* src,
+                                                     float* const* dst) {
+  TransposeTile32(src, dst);
+}
+[[gnu::always_inline]] inline void TransposeTileBody(const double* const* src,
+                                                     double* const* dst) {
+  TransposeTile64(src, dst);
+}
+[[gnu::always_inline]] inline void TransposeTileBody(
+    const int64_t* const* src, int64_t* const* dst) {
+  TransposeTile64(src, dst);
+}
+
+// ISA entry points. The bodies above carry no target of their own, so they
+// can be inlined into each of these and get compiled for its instruction set.
+
+template <typename T>
+[[gnu::target("avx512f,avx512dq")]] void AddAvx512(T* dst, const T* src,
+                                                   std::size_t count) {
+  AddBody<T, 64>(dst, src, count);
+}
+template <typename T>
+[[gnu::target("avx2,fma")]] void AddAvx2(T* dst, const T* src,
+                                         std::size_t count) {
+  AddBody<T, 32>(dst, src, count);
+}
+template <typename T>
+void AddBaseline(T* dst, const T* src, std::size_t count) {
+  AddBody<T, 16>(dst, src, count);
+}
+
+template <typename T>
+[[gnu::target("avx512f,avx512dq")]] void SubtractAvx512(T* dst, const T* src,
+                                                        std::size_t count) {
+  SubtractBody<T, 64>(dst, src, count);
+}
+template <typename T>
+[[gnu::target("avx2,fma")]] void SubtractAvx2(T* dst, const T* src,
+                                              std::size_t count) {
+  SubtractBody<T, 32>(dst, src, count);
+}
+template <typename T>
+void SubtractBaseline(T* dst, const T* src, std::size_t count) {
+  SubtractBody<T, 16>(dst, src, count);
+}
+
+template <typename T>
+[[gnu::target("avx512f,avx512dq")]] void ScaleAvx512(T* dst, T factor,
+                                                     std::size_t count) {
+  ScaleBody<T, 64>(dst, factor, count);
+}
+template <typename T>
+[[gnu::target("avx2,fma")]] void ScaleAvx2(T* dst, T factor,
+                                           std::size_t count) {
+  ScaleBody<T, 32>(dst, factor, count);
+}
+template <typename T>
+void ScaleBaseline(T* dst, T factor, std::size_t count) {
+  ScaleBody<T, 16>(dst, factor, count);
+}
+
+template <typename T, std::size_t Rows, std::size_t Inner, std::size_t Columns>
+[[gnu::target("avx512f,avx512dq")]] void MultiplyBatchAvx512(
+    const T* left, const T* right, T* result, std::size_t stride,
+    std::size_t begin, std::size_t end) {
+  MultiplyBatchBody<T, 64, Rows, Inner, Columns>(left, right, result, stride,
+                                                 begin, end);
+}
+template <typename T, std::size_t Rows, std::size_t Inner, std::size_t Columns>
+[[gnu::target("avx2,fma")]] void MultiplyBatchAvx2(
+    const T* left, const T* right, T* result, std::size_t stride,
+    std::size_t begin, std::size_t end) {
+  MultiplyBatchBody<T, 32, Rows, Inner, Columns>(left, right, result, stride,
+                                                 begin, end);
+}
+template <typename T, std::size_t Rows, std::size_t Inner, std::size_t Columns>
+void MultiplyBatchBaseline(const T* left, const T* right, T* result,
+                           std::size_t stride, std::size_t begin,
+                           std::size_t end) {
+  MultiplyBatchBody<T, 16, Rows, Inner, Columns>(left, right, result, stride,
+                                                 begin, end);
+}
+
+template <typename Semiring, typename T, std::size_t Rows,
+          std::size_t Columns>
+[[gnu::target("avx512f,avx512dq")]] void MicroKernelAvx512(const T* left,
+                                                           const T* right,
+                                                           std::size_t depth,
+                                                           T* acc) {
+  MicroKernelBody<Semiring, T, 64, Rows, Columns>(left, right, depth, acc);
+}
+template <typename Semiring, typename T, std::size_t Rows,
+          std::size_t Columns>
+[[gnu::target("avx2,fma")]] void MicroKernelAvx2(const T* left,
+                                                 const T* right,
+                                                 std::size_t depth, T* acc) {
+  MicroKernelBody<Semiring, T, 32, Rows, Columns>(left, right, depth, acc);
+}
+template <typename Semiring, typename T, std::size_t Rows,
+          std::size_t Columns>
+void MicroKernelBaseline(const T* left, const T* right, std::size_t depth,
+                         T* acc) {
+  MicroKernelBody<Semiring, T, 16, Rows, Columns>(left, right, depth, acc);
+}
+
+template <typename T>
+[[gnu::target("avx2,fma")]] void TransposeTileAvx2(const T* const* src,
+                                                   T* const* dst) {
+  TransposeTileBody(src, dst);
+}
+template <typename T>
+void TransposeTileBaseline(const T* const* src, T* const* dst) {
+  TransposeTileBody(src, dst);
+}
+
+// Dispatchers, meant for float, double and int64_t only.
+
+template <typename T>
+void Add(T* dst, const T* src, std::size_t count) {
+  switch (DetectIsa()) {
+    case Isa::kAvx512:
+      AddAvx512(dst, src, count);
+      break;
+    case Isa::kAvx2:
+      AddAvx2(dst, src, count);
+      break;
+    default:
+      AddBaseline(dst, src, count);
+  }
+}
+
+template <typename T>
+void Subtract(T* dst, const T* src, std::size_t count) {
+  switch (DetectIsa()) {
+    case Isa::kAvx512:
+      SubtractAvx512(dst, src, count);
+      break;
+    case Isa::kAvx2:
+      SubtractAvx2(dst, src, count);
+      break;
+    default:
+      SubtractBaseline(dst, src, count);
+  }
+}
+
+template <typename T>
+void Scale(T* dst, T factor, std::size_t count) {
+  switch (DetectIsa()) {
+    case Isa::kAvx512:
+      ScaleAvx512(dst, factor, count);
+      break;
+    case Isa::kAvx2:
+      ScaleAvx2(dst, factor, count);
+      break;
+    default:
+      ScaleBaseline(dst, factor, count);
+  }
+}
+
+template <typename T, std::size_t Rows, std::size_t Inner, std::size_t Columns>
+void MultiplyBatch(const T* left, const T* right, T* result,
+                   std::size_t stride, std::size_t begin, std::size_t end) {
+  switch (DetectIsa()) {
+    case Isa::kAvx512:
+      MultiplyBatchAvx512<T, Rows, Inner, Columns>(left, right, result,
+                                                   stride, begin, end);
+      break;
+    case Isa::kAvx2:
+      MultiplyBatchAvx2<T, Rows, Inner, Columns>(left, right, result, stride,
+                                                 begin, end);
+      break;
+    default:
+      MultiplyBatchBaseline<T, Rows, Inner, Columns>(left, right, result,
+                                                     stride, begin, end);
+  }
+}
+
+template <typename Semiring, typename T, std::size_t Rows,
+          std::size_t Columns>
+void MicroKernel(const T* left, const T* right, std::size_t depth, T* acc) {
+  switch (DetectIsa()) {
+    case Isa::kAvx512:
+      MicroKernelAvx512<Semiring, T, Rows, Columns>(left, right, depth, acc);
+      break;
+    case Isa::kAvx2:
+      MicroKernelAvx2<Semiring, T, Rows, Columns>(left, right, depth, acc);
+      break;
+    default:
+      MicroKernelBaseline<Semiring, T, Rows, Columns>(left, right, depth,
+                                                      acc);
+  }
+}
+
+template <typename T>
+void TransposeTile(const T* const* src, T* const* dst) {
+  if (DetectIsa() == Isa::kBaseline) {
+    TransposeTileBaseline(src, dst);
+  } else {
+    TransposeTileAvx2(src, dst);
+  }
+}
+
+}  // namespace utils::simd
+
+#endif
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "dynamic_matrix.hpp"
+#include "matrix.hpp"
+#include "thread_pool.hpp"
+
+// Compressed sparse matrix, by rows (CSR) or by columns (CSC). Either way
+// offsets_ has one entry per row (column) plus one, and the non-zeros of
+// row (column) i are values_[offsets_[i]..offsets_[i + 1]), their column
+// (row) numbers in indices_, sorted. Products with dense operands come in a
+// serial form through operator* and a parallel one through Multiply(...,
+// pool); mismatched shapes throw std::invalid_argument.
+template <typename T = int64_t>
+class SparseMatrix {
+ public:
+  enum class Format { kCsr, kCsc };
+
+  struct Triplet {
+    std::size_t row;
+    std::size_t column;
+    T value;
+  };
+
+  // Entries at the same position are summed, entries that end up equal to
+  // T() are kept.
+  SparseMatrix(std::size_t rows, std::size_t columns,
+               const std::vector<Triplet>& triplets,
+               Format format = Format::kCsr)
+      : rows_(rows), columns_(columns), format_(format) {
+    for (const auto& triplet : triplets) {
+      if (triplet.row >= rows_ || triplet.column >= columns_) {
+        throw std::invalid_argument("SparseMatrix: triplet out of range");
+      }
+    }
+    std::vector<std::size_t> order(triplets.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [this, &triplets](std::size_t left, std::size_t right) {
+                return Key(triplets[left]) < Key(triplets[right]);
+              });
+
+    offsets_.assign(Major() + 1, 0);
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      const Triplet& triplet = triplets[order[i]];
+      if (i != 0 && Key(triplets[order[i - 1]]) == Key(triplet)) {
+        values_.back() += triplet.value;
+        continue;
+      }
+      ++offsets_[Key(triplet).first + 1];
+      indices_.push_back(Key(triplet).second);
+      values_.push_back(triplet.value);
+    }
+    std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+  }
+
+  template <std::size_t N, std::size_t M, typename Layout>
+  explicit SparseMatrix(const Matrix<N, M, T, Layout>& matrix,
+                        Format format = Format::kCsr)
+      : SparseMatrix(N, M, NonZeroTriplets(matrix, N, M), format) {}
+
+  explicit SparseMatrix(const DynamicMatrix<T>& matrix,
+                        Format format = Format::kCsr)
+      : SparseMatrix(matrix.Rows(), matrix.Columns(),
+                     NonZeroTriplets(matrix, matrix.Rows(), matrix.Columns()),
+                     format) {}
+
+  ~SparseMatrix() = default;
+
+  std::size_t Rows() const { return rows_; }
+  std::size_t Columns() const { return columns_; }
+  std::size_t NonZeros() const { return values_.size(); }
+  Format GetFormat() const { return format_; }
+
+  // The same matrix compressed the other way round: a counting sort by the
+  // minor index, linear in the number of non-zeros.
+  SparseMatrix Converted(Format format) const {
+    if (format == format_) {
+      return *this;
+    }
+    SparseMatrix result(rows_, columns_, format);
+    std::size_t minor = result.Major();
+    result.offsets_.assign(minor + 1, 0);
+    for (std::size_t index : indices_) {
+      ++result.offsets_[index + 1];
+    }
+    std::partial_sum(result.offsets_.begin(), result.offsets_.end(),
+                     result.offsets_.begin());
+    result.indices_.resize(NonZeros());
+    result.values_.resize(NonZeros());
+    std::vector<std::size_t> next(result.offsets_.begin(),
+                                  result.offsets_.end() - 1);
+    for (std::size_t i = 0; i < Major(); ++i) {
+      for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; ++k) {
+        std::size_t position = next[indices_[k]]++;
+        result.indices_[position] = i;
+        result.values_[position] = values_[k];
+      }
+    }
+    return result;
+  }
+
+  DynamicMatrix<T> ToDense() const {
+    DynamicMatrix<T> result(rows_, columns_);
+    for (std::size_t i = 0; i < Major(); ++i) {
+      for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; ++k) {
+        Element(result, i, indices_[k]) = values_[k];
+      }
+    }
+    return result;
+  }
+
+  // T() for positions that are not stored; binary search within the row
+  // (column).
+  T operator()(std::size_t row, std::size_t column) const {
+    std::size_t major = (format_ == Format::kCsr ? row : column);
+    std::size_t minor = (format_ == Format::kCsr ? column : row);
+    auto begin = indices_.begin() + offsets_[major];
+    auto end = indices_.begin() + offsets_[major + 1];
+    auto found = std::lower_bound(begin, end, minor);
+    if (found == end || *found != minor) {
+      return T();
+    }
+    return values_[found - indices_.begin()];
+  }
+
+  friend std::vector<T> operator*(const SparseMatrix& left,
+                                  const std::vector<T>& right) {
+    left.CheckInner(right.size());
+    std::vector<T> result(left.rows_, T());
+    left.MultiplyVector(right, result.data(), 0, left.Major());
+    return result;
+  }
+
+  friend DynamicMatrix<T> operator*(const SparseMatrix& left,
+                                    const DynamicMatrix<T>& right) {
+    left.CheckInner(right.Rows());
+    DynamicMatrix<T> result(left.rows_, right.Columns());
+    left.MultiplyDense(right, result, 0, right.Columns());
+    return result;
+  }
+
+  // Rows of a CSR matrix are split into ranges of about equal non-zero
+  // count, several tasks per thread. A CSC matrix can only scatter into the
+  // result, so its columns are split into one range per thread, each summed
+  // into an accumulator of its own (the first straight into the result),
+  // and a second pass adds the accumulators up in row ranges. Accumulators
+  // thus cost one vector per thread, however many tasks would balance best.
+  friend std::vector<T> Multiply(const SparseMatrix& left,
+                                 const std::vector<T>& right,
+                                 ThreadPool& pool) {
+    left.CheckInner(right.size());
+    std::vector<T> result(left.rows_, T());
+    std::vector<std::function<void()>> tasks;
+    if (left.format_ == Format::kCsr) {
+      std::vector<std::size_t> bounds =
+          left.Split(pool.Size() * kTasksPerThread);
+      for (std::size_t part = 0; part + 1 < bounds.size(); ++part) {
+        tasks.emplace_back([&left, &right, &result, &bounds, part] {
+          left.MultiplyVector(right, result.data(), bounds[part],
+                              bounds[part + 1]);
+        });
+      }
+      pool.Run(std::move(tasks));
+      return result;
+    }
+
+    std::vector<std::size_t> bounds = left.Split(pool.Size());
+    std::size_t parts = bounds.size() - 1;
+    std::vector<std::vector<T>> partial(parts);
+    for (std::size_t part = 0; part < parts; ++part) {
+      tasks.emplace_back([&left, &right, &result, &partial, &bounds, part] {
+        T* accumulator = result.data();
+        if (part != 0) {
+          partial[part].assign(left.rows_, T());
+          accumulator = partial[part].data();
+        }
+        left.MultiplyVector(right, accumulator, bounds[part],
+                            bounds[part + 1]);
+      });
+    }
+    pool.Run(std::move(tasks));
+    if (parts == 1) {
+      return result;
+    }
+    std::size_t ranges = pool.Size() * kTasksPerThread;
+    std::size_t chunk = std::max<std::size_t>(
+        (left.rows_ + ranges - 1) / ranges, utils::kCacheLine / sizeof(T));
+    tasks.clear();
+    for (std::size_t begin = 0; begin < left.rows_; begin += chunk) {
+      tasks.emplace_back([&partial, &result, begin, chunk] {
+        std::size_t count = std::min(chunk, result.size() - begin);
+        for (std::size_t part = 1; part < partial.size(); ++part) {
+          utils::AddTo(result.data() + begin, partial[part].data() + begin,
+                       count);
+        }
+      });
+    }
+    pool.Run(std::move(tasks));
+    return result;
+  }
+
+  // Split by rows for CSR. For CSC the tasks take disjoint ranges of result
+  // columns instead, so no two of them write the same element.
+  friend DynamicMatrix<T> Multiply(const SparseMatrix& left,
+                                   const DynamicMatrix<T>& right,
+                                   ThreadPool& pool) {
+    left.CheckInner(right.Rows());
+    DynamicMatrix<T> result(left.rows_, right.Columns());
+    std::vector<std::function<void()>> tasks;
+    if (left.format_ == Format::kCsr) {
+      std::vector<std::size_t> bounds =
+          left.Split(pool.Size() * kTasksPerThread);
+      for (std::size_t part = 0; part + 1 < bounds.size(); ++part) {
+        tasks.emplace_back([&left, &right, &result, &bounds, part] {
+          left.MultiplyRows(right, result, bounds[part], bounds[part + 1]);
+        });
+      }
+      pool.Run(std::move(tasks));
+      return result;
+    }
+
+    std::size_t parts = pool.Size() * kTasksPerThread;
+    std::size_t chunk = std::max<std::size_t>(
+        (right.Columns() + parts - 1) / parts, utils::kCacheLine / sizeof(T));
+    for (std::size_t begin = 0; begin < right.Columns(); begin += chunk) {
+      std::size_t end = std::min(begin + chunk, right.Columns());
+      tasks.emplace_back([&left, &right, &result, begin, end] {
+        left.MultiplyDense(right, result, begin, end);
+      });
+    }
+    pool.Run(std::move(tasks));
+    return result;
+  }
+
+  bool operator==(const SparseMatrix& other) const {
+    return rows_ == other.rows_ && columns_ == other.columns_ &&
+           format_ == other.format_ && offsets_ == other.offsets_ &&
+           indices_ == other.indices_ && values_ == other.values_;
+  }
+
+ private:
+  // tasks per pool thread, so that uneven rows even out
+  static const std::size_t kTasksPerThread = 4;
+
+  SparseMatrix(std::size_t rows, std::size_t columns, Format format)
+      : rows_(rows), columns_(columns), format_(format) {}
+
+  template <typename Dense>
+  static std::vector<Triplet> NonZeroTriplets(const Dense& matrix,
+                                              std::size_t rows,
+                                              std::size_t columns) {
+    std::vector<Triplet> result;
+    for (std::size_t i = 0; i < rows; ++i) {
+      for (std::size_t j = 0; j < columns; ++j) {
+        if (matrix(i, j) != T()) {
+          result.push_back({i, j, matrix(i, j)});
+        }
+      }
+    }
+    return result;
+  }
+
+  std::size_t Major() const {
+    return format_ == Format::kCsr ? rows_ : columns_;
+  }
+
+  std::pair<std::size_t, std::size_t> Key(const Triplet& triplet) const {
+    if (format_ == Format::kCsr) {
+      return {triplet.row, triplet.column};
+    }
+    return {triplet.column, triplet.row};
+  }
+
+  // dense(row, column) for the entry at (major, minor) of this format
+  T& Element(DynamicMatrix<T>& dense, std::size_t major,
+             std::size_t minor) const {
+    return format_ == Format::kCsr ? dense(major, minor) : dense(minor, major);
+  }
+
+  void CheckInner(std::size_t size) const {
+    if (columns_ != size) {
+      throw std::invalid_argument("SparseMatrix: inner dimensions differ");
+    }
+  }
+
+  // Boundaries of at most parts ranges of rows (columns) holding about the
+  // same number of non-zeros each.
+  std::vector<std::size_t> Split(std::size_t parts) const {
+    std::vector<std::size_t> bounds = {0};
+    for (std::size_t part = 1; part < parts; ++part) {
+      std::size_t target = NonZeros() * part / parts;
+      std::size_t bound =
+          std::lower_bound(offsets_.begin(), offsets_.end(), target) -
+          offsets_.begin();
+      bound = std::min(bound, Major());
+      if (bound > bounds.back()) {
+        bounds.push_back(bound);
+      }
+    }
+    if (bounds.back() != Major() || bounds.size() == 1) {
+      bounds.push_back(Major());
+    }
+    return bounds;
+  }
+
+  // result += this * vector restricted to rows (columns) [begin, end)
+  void MultiplyVector(const std::vector<T>& vector, T* result,
+                      std::size_t begin, std::size_t end) const {
+    for (std::size_t i = begin; i < end; ++i) {
+      if (format_ == Format::kCsr) {
+        T sum = T();
+        for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; ++k) {
+          sum += values_[k] * vector[indices_[k]];
+        }
+        result[i] += sum;
+      } else {
+        for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; ++k) {
+          result[indices_[k]] += values_[k] * vector[i];
+        }
+      }
+    }
+  }
+
+  // result rows [begin, end) = this * dense, CSR only
+  void MultiplyRows(const DynamicMatrix<T>& dense, DynamicMatrix<T>& result,
+                    std::size_t begin, std::size_t end) const {
+    for (std::size_t i = begin; i < end; ++i) {
+      for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; ++k) {
+        AddScaledRow(dense, indices_[k], values_[k], result, i, 0,
+                     dense.Columns());
+      }
+    }
+  }
+
+  // result columns [begin, end) = this * dense, either format
+  void MultiplyDense(const DynamicMatrix<T>& dense, DynamicMatrix<T>& result,
+                     std::size_t begin, std::size_t end) const {
+    for (std::size_t i = 0; i < Major(); ++i) {
+      for (std::size_t k = offsets_[i]; k < offsets_[i + 1]; ++k) {
+        if (format_ == Format::kCsr) {
+          AddScaledRow(dense, indices_[k], values_[k], result, i, begin, end);
+        } else {
+          AddScaledRow(dense, i, values_[k], result, indices_[k], begin, end);
+        }
+      }
+    }
+  }
+
+  // result(target, begin..end) += factor * dense(source, begin..end)
+  static void AddScaledRow(const DynamicMatrix<T>& dense, std::size_t source,
+                           const T& factor, DynamicMatrix<T>& result,
+                           std::size_t target, std::size_t begin,
+                           std::size_t end) {
+    if (begin == end) {
+      return;
+    }
+    const T* src = &dense(source, 0);
+    T* dst = &result(target, 0);
+    for (std::size_t j = begin; j < end; ++j) {
+      dst[j] += factor * src[j];
+    }
+  }
+
+  std::size_t rows_;
+  std::size_t columns_;
+  Format format_;
+  std::vector<std::size_t> offsets_;
+  std::vector<std::size_t> indices_;
+  std::vector<T> values_;
+};
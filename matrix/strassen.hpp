@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "kernels.hpp"
+
+namespace utils {
+
+// Square blocks at or below this size go to the blocked kernel. Below a few
+// hundred the extra additions and temporaries of a Strassen step cost more
+// than the one multiplication in eight that it saves.
+const std::size_t kStrassenCutoff = 512;
+
+// dst = left + right (or left - right) over size x size blocks.
+template <typename T>
+void CombineBlocks(StridedBlock<T> dst, StridedBlock<T> left,
+                   StridedBlock<T> right, std::size_t size, bool subtract) {
+  for (std::size_t i = 0; i < size; ++i) {
+    T* row = &dst(i, 0);
+    std::copy(&left(i, 0), &left(i, 0) + size, row);
+    if (subtract) {
+      SubtractFrom(row, &right(i, 0), size);
+    } else {
+      AddTo(row, &right(i, 0), size);
+    }
+  }
+}
+
+// result = left * right for size x size blocks, where size is cutoff-sized
+// times a power of two. Winograd's form of Strassen: 7 half-size products
+// and 15 half-size additions per level instead of 8 products.
+template <typename T>
+void StrassenStep(StridedBlock<T> left, StridedBlock<T> right,
+                  StridedBlock<T> result, std::size_t size,
+                  std::size_t cutoff) {
+  if (size <= cutoff) {
+    for (std::size_t i = 0; i < size; ++i) {
+      std::fill(&result(i, 0), &result(i, 0) + size, T());
+    }
+    Multiply(left, right, result, size, size, size);
+    return;
+  }
+
+  std::size_t half = size / 2;
+  std::size_t area = half * half;
+  // s1..s4, t1..t4 and the seven products, each half x half
+  AlignedVector<T> workspace(15 * area);
+  auto block = [&workspace, area, half](std::size_t index) {
+    return StridedBlock<T>{workspace.data() + index * area, half};
+  };
+  StridedBlock<T> a11 = left.Quadrant(0, 0, half);
+  StridedBlock<T> a12 = left.Quadrant(0, 1, half);
+  StridedBlock<T> a21 = left.Quadrant(1, 0, half);
+  StridedBlock<T> a22 = left.Quadrant(1, 1, half);
+  StridedBlock<T> b11 = right.Quadrant(0, 0, half);
+  StridedBlock<T> b12 = right.Quadrant(0, 1, half);
+  StridedBlock<T> b21 = right.Quadrant(1, 0, half);
+  StridedBlock<T> b22 = right.Quadrant(1, 1, half);
+  StridedBlock<T> s1 = block(0), s2 = block(1), s3 = block(2), s4 = block(3);
+  StridedBlock<T> t1 = block(4), t2 = block(5), t3 = block(6), t4 = block(7);
+  StridedBlock<T> p1 = block(8), p2 = block(9), p3 = block(10);
+  StridedBlock<T> p4 = block(11), p5 = block(12), p6 = block(13);
+  StridedBlock<T> p7 = block(14);
+
+  CombineBlocks(s1, a21, a22, half, false);
+  CombineBlocks(s2, s1, a11, half, true);
+  CombineBlocks(s3, a11, a21, half, true);
+  CombineBlocks(s4, a12, s2, half, true);
+  CombineBlocks(t1, b12, b11, half, true);
+  CombineBlocks(t2, b22, t1, half, true);
+  CombineBlocks(t3, b22, b12, half, true);
+  CombineBlocks(t4, t2, b21, half, true);
+
+  StrassenStep(a11, b11, p1, half, cutoff);
+  StrassenStep(a12, b21, p2, half, cutoff);
+  StrassenStep(s4, b22, p3, half, cutoff);
+  StrassenStep(a22, t4, p4, half, cutoff);
+  StrassenStep(s1, t1, p5, half, cutoff);
+  StrassenStep(s2, t2, p6, half, cutoff);
+  StrassenStep(s3, t3, p7, half, cutoff);
+
+  // c11 = p1 + p2, u2 = p1 + p6, u3 = u2 + p7, c12 = u2 + p5 + p3,
+  // c21 = u3 - p4, c22 = u3 + p5; u2 and u3 reuse s1 and s2
+  StridedBlock<T> u2 = s1, u3 = s2;
+  CombineBlocks(result.Quadrant(0, 0, half), p1, p2, half, false);
+  CombineBlocks(u2, p1, p6, half, false);
+  CombineBlocks(u3, u2, p7, half, false);
+  CombineBlocks(result.Quadrant(0, 1, half), u2, p5, half, false);
+  for (std::size_t i = 0; i < half; ++i) {
+    AddTo(&result.Quadrant(0, 1, half)(i, 0), &p3(i, 0), half);
+  }
+  CombineBlocks(result.Quadrant(1, 0, half), u3, p4, half, true);
+  CombineBlocks(result.Quadrant(1, 1, half), u3, p5, half, false);
+}
+
+// result = left * right for size x size operands, zero-padding them to the
+// cutoff-sized multiple of a power of two that the recursion needs.
+template <typename Left, typename Right, typename Result>
+void MultiplyStrassen(const Left& left, const Right& right, Result& result,
+                      std::size_t size, std::size_t cutoff) {
+  using T = ElementType<Result>;
+  cutoff = std::max<std::size_t>(cutoff, 1);
+  std::size_t levels = 0;
+  std::size_t base = size;
+  while (base > cutoff) {
+    base = (base + 1) / 2;
+    ++levels;
+  }
+  if (levels == 0) {
+    Multiply(left, right, result, size, size, size);
+    return;
+  }
+
+  std::size_t padded = base << levels;
+  AlignedVector<T> buffer(3 * padded * padded, T());
+  StridedBlock<T> padded_left{buffer.data(), padded};
+  StridedBlock<T> padded_right{buffer.data() + padded * padded, padded};
+  StridedBlock<T> padded_result{buffer.data() + 2 * padded * padded, padded};
+  for (std::size_t i = 0; i < size; ++i) {
+    for (std::size_t j = 0; j < size; ++j) {
+      padded_left(i, j) = left(i, j);
+      padded_right(i, j) = right(i, j);
+    }
+  }
+  StrassenStep(padded_left, padded_right, padded_result, padded, base);
+  for (std::size_t i = 0; i < size; ++i) {
+    for (std::size_t j = 0; j < size; ++j) {
+      result(i, j) = padded_result(i, j);
+    }
+  }
+}
+
+}  // namespace utils
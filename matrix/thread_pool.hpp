@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join pool with one task deque per thread. Run() deals a batch of
+// tasks round-robin over the deques, every thread pops from the back of its
+// own deque and steals from the front of the others once it runs dry. The
+// calling thread works as thread 0 until the whole batch is done.
+class ThreadPool {
+ public:
+  explicit ThreadPool(
+      std::size_t threads = std::max(1U, std::thread::hardware_concurrency()))
+      : queues_(std::max<std::size_t>(threads, 1)) {
+    for (auto& queue : queues_) {
+      queue = std::make_unique<Queue>();
+    }
+    for (std::size_t i = 1; i < queues_.size(); ++i) {
+      workers_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+  }
+
+  ThreadPool(const ThreadPool& other) = delete;
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  std::size_t Size() const { return queues_.size(); }
+
+  // Blocks until every task has finished and rethrows the first exception
+  // thrown by any of them. Not meant to be called from inside a task.
+  void Run(std::vector<std::function<void()>> tasks) {
+    if (tasks.empty()) {
+      return;
+    }
+    pending_ = tasks.size();
+    {
+      // A worker still sweeping the deques may pop a task as soon as it is
+      // pushed, so each one is counted under its deque's lock, the lock
+      // TryPop uncounts it under: queued_ never misses a decrement and
+      // never counts a task that is not in a deque.
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (std::size_t i = 0; i < tasks.size(); ++i) {
+        Queue& queue = *queues_[i % queues_.size()];
+        std::lock_guard<std::mutex> queue_lock(queue.mutex);
+        queue.tasks.push_back(std::move(tasks[i]));
+        ++queued_;
+      }
+    }
+    wake_.notify_all();
+
+    std::function<void()> task;
+    while (TryPop(0, task)) {
+      Execute(task);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+    if (error_) {
+      std::exception_ptr error = std::move(error_);
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  bool TryPop(std::size_t index, std::function<void()>& task) {
+    for (std::size_t i = 0; i < queues_.size(); ++i) {
+      Queue& queue = *queues_[(index + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      if (i == 0) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+      --queued_;
+      return true;
+    }
+    return false;
+  }
+
+  void Execute(std::function<void()>& task) {
+    try {
+      task();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+    if (--pending_ == 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_.notify_all();
+    }
+  }
+
+  void WorkerLoop(std::size_t index) {
+    std::function<void()> task;
+    while (true) {
+      if (TryPop(index, task)) {
+        Execute(task);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+      if (stop_ && queued_ == 0) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::atomic<std::size_t> queued_ = 0;
+  std::atomic<std::size_t> pending_ = 0;
+  std::exception_ptr error_;
+  bool stop_ = false;
+};